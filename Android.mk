@@ -16,17 +16,32 @@ LOCAL_PATH:= $(call my-dir)
 
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
+	src/actuator.c \
 	src/configuration.c \
 	src/control.c \
+	src/curve.c \
 	src/mitigation.c \
+	src/model.c \
 	src/resource.c \
+	src/slowread.c \
 	src/threshold.c \
+	src/pid.c \
+	src/realtime.c \
+	src/recorder.c \
+	src/state.c \
 	src/dom.c \
 	src/libxml2parser.c \
 	src/watch.c \
+	src/uevent.c \
+	src/uring.c \
 	src/thermal_zone.c \
 	src/cpufreq.c \
+	src/devfreq.c \
+	src/hotplug.c \
+	src/intent.c \
+	src/freq_table.c \
 	src/util.c \
+	src/log.c \
 	src/main.c \
 
 LOCAL_SHARED_LIBRARIES := liblog libcutils
@@ -59,3 +74,10 @@ LOCAL_SRC_FILES := thermonitor.c
 LOCAL_MODULE := thermonitor
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := thermbench.c src/uring.c src/log.c src/util.c
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_MODULE := thermbench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
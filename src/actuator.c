@@ -0,0 +1,304 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "log.h"
+#include "actuator.h"
+
+#define ACTUATOR_RING_SIZE 64
+#define ACTUATOR_STAGE_SIZE 64
+
+/*
+ * Resource writes can be handed to an actuation thread, so a slow
+ * actuator does not hold up sensing and evaluation in the main loop.
+ *
+ * The main loop is the only producer and the actuation thread the only
+ * consumer of a ring of write commands, so the ring needs no lock.  Each
+ * write bumps the write_seq of its resource and a command is skipped when
+ * a newer one for the same resource is already queued, so only the last
+ * value written to a resource reaches it.
+ *
+ * Resources written from the thread may be read by the main loop at the
+ * same time.  "sysfs", "cooling-device", "powercap" and "cgroup" use
+ * pread/pwrite on their shared fds, "cpufreq" and "intent" take a lock,
+ * "hotplug" keeps its mask atomic, and "devfreq" writes an fd of its own.
+ * Caches such as the last state written are only touched by writes.
+ *
+ * While the configurations are evaluated, writes are staged instead.  A
+ * resource written again in the same tick only keeps its latest value,
+ * and the staged writes are flushed at the end of the tick in the order
+ * the resources were first written.
+ */
+struct actuator_cmd {
+	struct resource *resource;
+	unsigned int seq;
+	int numeric;
+	int value;
+	unsigned int len;
+	char buf[256];
+};
+
+struct actuator_stage {
+	int active;
+	int count;
+	unsigned int coalesced;
+	unsigned int reported;
+	struct actuator_cmd cmds[ACTUATOR_STAGE_SIZE];
+};
+
+struct actuator {
+	pthread_t thread;
+	int running;
+	int fd;
+	/* the main loop blocks on space_fd while waiting is set */
+	int space_fd;
+	int waiting;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int skipped;
+	struct actuator_cmd ring[ACTUATOR_RING_SIZE];
+};
+
+static struct actuator g_actuator = {
+	.fd = -1,
+	.space_fd = -1,
+};
+
+static struct actuator_stage g_actuator_stage;
+
+static void actuator_run_cmd(struct actuator_cmd *cmd)
+{
+	if (cmd->numeric)
+		resource_write_int(cmd->resource, cmd->value);
+	else
+		resource_write_value(cmd->resource, cmd->buf, cmd->len);
+}
+
+static void actuator_signal(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0)
+		LOGW("unable to signal actuator eventfd\n");
+}
+
+static void *actuator_thread(void *data)
+{
+	struct actuator *a = data;
+	struct actuator_cmd *cmd;
+	unsigned int head;
+	uint64_t events;
+
+	for (;;) {
+		head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+		if (a->tail == head) {
+			if (!__atomic_load_n(&a->running, __ATOMIC_ACQUIRE))
+				break;
+			if (read(a->fd, &events, sizeof(events)) < 0)
+				break;
+			continue;
+		}
+
+		cmd = &a->ring[a->tail % ACTUATOR_RING_SIZE];
+		if (cmd->seq == __atomic_load_n(&cmd->resource->write_seq,
+				__ATOMIC_ACQUIRE))
+			actuator_run_cmd(cmd);
+		else
+			a->skipped++;
+		__atomic_store_n(&a->tail, a->tail + 1, __ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&a->waiting, 0, __ATOMIC_SEQ_CST))
+			actuator_signal(a->space_fd);
+	}
+
+	return NULL;
+}
+
+static void actuator_kick(struct actuator *a)
+{
+	actuator_signal(a->fd);
+}
+
+static int actuator_full(struct actuator *a)
+{
+	return a->head - __atomic_load_n(&a->tail, __ATOMIC_SEQ_CST) ==
+			ACTUATOR_RING_SIZE;
+}
+
+static int actuator_queue(struct resource *res, int numeric, int value,
+		const char *val, unsigned int len)
+{
+	struct actuator *a = &g_actuator;
+	struct actuator_cmd *cmd;
+
+	if (len >= sizeof(cmd->buf))
+		len = sizeof(cmd->buf) - 1;
+
+	/*
+	 * A full ring means the actuator is stuck.  Sleep until it frees a
+	 * slot rather than spin, which could starve it when the main loop
+	 * runs SCHED_FIFO on the same cpu.  waiting is set before the ring is
+	 * checked again, so the thread either sees it or left a free slot.
+	 */
+	while (actuator_full(a)) {
+		uint64_t events;
+
+		__atomic_store_n(&a->waiting, 1, __ATOMIC_SEQ_CST);
+		if (!actuator_full(a)) {
+			__atomic_store_n(&a->waiting, 0, __ATOMIC_SEQ_CST);
+			break;
+		}
+		actuator_kick(a);
+		if (read(a->space_fd, &events, sizeof(events)) < 0)
+			LOGW("unable to wait for actuator\n");
+	}
+
+	cmd = &a->ring[a->head % ACTUATOR_RING_SIZE];
+	cmd->resource = res;
+	cmd->numeric = numeric;
+	cmd->value = value;
+	cmd->len = len;
+	if (!numeric) {
+		memcpy(cmd->buf, val, len);
+		cmd->buf[len] = 0;
+	}
+	cmd->seq = __atomic_add_fetch(&res->write_seq, 1, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&a->head, a->head + 1, __ATOMIC_RELEASE);
+	actuator_kick(a);
+	return 0;
+}
+
+static int actuator_dispatch(struct resource *res, int numeric, int value,
+		const char *val, unsigned int len)
+{
+	if (g_actuator.running)
+		return actuator_queue(res, numeric, value, val, len);
+	if (numeric)
+		return resource_write_int(res, value);
+	return resource_write_value(res, val, len);
+}
+
+static int actuator_stage(struct resource *res, int numeric, int value,
+		const char *val, unsigned int len)
+{
+	struct actuator_stage *s = &g_actuator_stage;
+	struct actuator_cmd *cmd;
+
+	if (res->staged) {
+		cmd = &s->cmds[res->staged - 1];
+		s->coalesced++;
+	} else if (s->count < ACTUATOR_STAGE_SIZE) {
+		cmd = &s->cmds[s->count++];
+		cmd->resource = res;
+		res->staged = s->count;
+	} else {
+		return actuator_dispatch(res, numeric, value, val, len);
+	}
+
+	if (len >= sizeof(cmd->buf))
+		len = sizeof(cmd->buf) - 1;
+	cmd->numeric = numeric;
+	cmd->value = value;
+	cmd->len = len;
+	if (!numeric) {
+		memcpy(cmd->buf, val, len);
+		cmd->buf[len] = 0;
+	}
+	return 0;
+}
+
+int actuator_write_int(struct resource *res, int value)
+{
+	if (g_actuator_stage.active)
+		return actuator_stage(res, 1, value, NULL, 0);
+	return actuator_dispatch(res, 1, value, NULL, 0);
+}
+
+int actuator_write_value(struct resource *res, const char *val,
+		unsigned int len)
+{
+	if (g_actuator_stage.active)
+		return actuator_stage(res, 0, 0, val, len);
+	return actuator_dispatch(res, 0, 0, val, len);
+}
+
+void actuator_stage_begin(void)
+{
+	g_actuator_stage.active = 1;
+}
+
+void actuator_stage_flush(void)
+{
+	struct actuator_stage *s = &g_actuator_stage;
+	struct actuator_cmd *cmd;
+	int i;
+
+	if (s->coalesced != s->reported) {
+		LOGV("%u staged writes coalesced\n", s->coalesced - s->reported);
+		s->reported = s->coalesced;
+	}
+
+	s->active = 0;
+	for (i = 0; i < s->count; ++i) {
+		cmd = &s->cmds[i];
+		cmd->resource->staged = 0;
+		actuator_dispatch(cmd->resource, cmd->numeric, cmd->value,
+				cmd->buf, cmd->len);
+	}
+	s->count = 0;
+}
+
+int actuator_start(void)
+{
+	struct actuator *a = &g_actuator;
+
+	if (a->running)
+		return 0;
+
+	a->fd = eventfd(0, EFD_CLOEXEC);
+	a->space_fd = eventfd(0, EFD_CLOEXEC);
+	if (a->fd == -1 || a->space_fd == -1) {
+		LOGE("unable to create actuator eventfd\n");
+		if (a->fd != -1)
+			close(a->fd);
+		if (a->space_fd != -1)
+			close(a->space_fd);
+		a->fd = a->space_fd = -1;
+		return -1;
+	}
+
+	a->running = 1;
+	if (pthread_create(&a->thread, NULL, actuator_thread, a)) {
+		LOGE("unable to start actuator thread\n");
+		a->running = 0;
+		close(a->fd);
+		close(a->space_fd);
+		a->fd = a->space_fd = -1;
+		return -1;
+	}
+
+	LOGI("actuator thread started\n");
+	return 0;
+}
+
+void actuator_stop(void)
+{
+	struct actuator *a = &g_actuator;
+
+	if (!a->running)
+		return;
+
+	__atomic_store_n(&a->running, 0, __ATOMIC_RELEASE);
+	actuator_kick(a);
+	pthread_join(a->thread, NULL);
+	close(a->fd);
+	close(a->space_fd);
+	a->fd = a->space_fd = -1;
+
+	LOGV("actuator stopped, %u superseded writes skipped,"
+			" %u coalesced\n", a->skipped,
+			g_actuator_stage.coalesced);
+}
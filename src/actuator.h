@@ -0,0 +1,16 @@
+#ifndef _ACTUATOR_H_
+#define _ACTUATOR_H_
+
+#include "resource.h"
+
+int actuator_start(void);
+void actuator_stop(void);
+
+void actuator_stage_begin(void);
+void actuator_stage_flush(void);
+
+int actuator_write_int(struct resource *res, int value);
+int actuator_write_value(struct resource *res, const char *val,
+		unsigned int len);
+
+#endif
@@ -4,15 +4,43 @@
 
 #include "log.h"
 #include "watch.h"
+#include "uevent.h"
+#include "intent.h"
+#include "actuator.h"
+#include "control.h"
+#include "realtime.h"
+#include "state.h"
 #include "configuration.h"
 
+/* loops run before the main loop is expected to stop allocating */
+#define CONFIGURATION_ALLOC_WARMUP 2
+
 static LIST(g_configuration_manager_list);
+static int g_configuration_check_allocs;
+
+/*
+ * Makes the main loop log every iteration that allocates memory once it
+ * has run CONFIGURATION_ALLOC_WARMUP times.
+ */
+void configuration_manager_check_allocs(void)
+{
+	g_configuration_check_allocs = 1;
+}
 
 void configuration_manager_add(struct configuration *cfg)
 {
 	list_append(&g_configuration_manager_list, &cfg->list_node);
 }
 
+void configuration_manager_foreach(void (* fn)(struct configuration *, void *),
+		void *data)
+{
+	struct list_node *node;
+
+	for_list_node(&g_configuration_manager_list, node)
+		fn(list_entry(node, struct configuration, list_node), data);
+}
+
 static void configuration_run(struct configuration *cfg, int value);
 
 void configuration_manager_run(void)
@@ -20,6 +48,9 @@ void configuration_manager_run(void)
 	struct configuration *cfg;
 	struct list_node *node;
 	struct watch *watch;
+	unsigned long allocs = 0;
+	unsigned long now;
+	unsigned int loops = 0;
 
 	if (list_first(&g_configuration_manager_list) == NULL) {
 		LOGE("no configurations to run, exiting\n");
@@ -46,46 +77,84 @@ void configuration_manager_run(void)
 	if (watch == NULL)
 		return;
 	watch_manager_set_watch(watch);
+	uevent_manager_enable();
+	intent_manager_enable();
+	control_manager_enable();
 
 	for_list_node(&g_configuration_manager_list, node) {
 		cfg = list_entry(node, struct configuration, list_node);
 		resource_enable(cfg->sensor);
+		if (cfg->interval)
+			cfg->ticket = watch_manager_add_timeout(cfg->interval);
 	}
 
 	watch_synchronize(watch);
 
 	for (;;) {
-		struct resource *res = NULL;
-		char buf[32];
 		int value;
-		int rc;
 
-		rc = value = 0;
+		resource_manager_tick();
+		actuator_stage_begin();
 		for_list_node(&g_configuration_manager_list, node) {
 			cfg = list_entry(node, struct configuration, list_node);
-			if (cfg->sensor != res) {
-				res = cfg->sensor;
-				rc = resource_read_value(cfg->sensor, buf, sizeof(buf));
-				if (rc > 0) {
-					buf[rc] = 0;
-					value = strtol(buf, 0, 0);
-				}
-			}
-			if (rc > 0)
-				configuration_run(cfg, value);
+			if (resource_sample(cfg->sensor, &value) == 0)
+				cfg->run(cfg, value);
 		}
+		actuator_stage_flush();
+		state_publish();
 		watch_manager_wait();
+
+		if (!g_configuration_check_allocs)
+			continue;
+		if (realtime_alloc_count(&now)) {
+			LOGW("allocations can not be counted\n");
+			g_configuration_check_allocs = 0;
+			continue;
+		}
+		if (loops < CONFIGURATION_ALLOC_WARMUP) {
+			if (++loops == CONFIGURATION_ALLOC_WARMUP)
+				LOGI("%lu allocations before steady state\n",
+						now);
+		} else if (now != allocs) {
+			LOGW("%lu allocations in main loop\n", now - allocs);
+		}
+		allocs = now;
 	}
 
 	for_list_node(&g_configuration_manager_list, node) {
 		cfg = list_entry(node, struct configuration, list_node);
+		if (cfg->ticket != NULL) {
+			watch_ticket_delete(cfg->ticket);
+			cfg->ticket = NULL;
+		}
 		resource_disable(cfg->sensor);
 	}
 
+	intent_manager_disable();
+	uevent_manager_disable();
 	watch_manager_set_watch(NULL);
 	watch_destroy(watch);
 }
 
+/*
+ * Initializes the common part of a configuration.  Other control modes
+ * embed a configuration and override run and destroy.
+ */
+int configuration_init(struct configuration *cfg, const char *sensor)
+{
+	cfg->sensor = resource_manager_find(sensor);
+	if (cfg->sensor == NULL)
+		return -1;
+	cfg->last_value = -1;
+	cfg->kind = "threshold";
+	cfg->run = configuration_run;
+
+	list_init(&cfg->unsatisfied);
+	list_init(&cfg->satisfied);
+
+	return 0;
+}
+
 struct configuration *configuration_create(const char *sensor)
 {
 	struct configuration *cfg;
@@ -94,14 +163,10 @@ struct configuration *configuration_create(const char *sensor)
 	if (cfg == NULL)
 		return NULL;
 
-	cfg->sensor = resource_manager_find(sensor);
-	if (cfg->sensor == NULL) {
+	if (configuration_init(cfg, sensor)) {
 		free(cfg);
 		return NULL;
 	}
-	cfg->last_value = -1;
-
-	list_init(&cfg->unsatisfied);
 
 	return cfg;
 }
@@ -120,7 +185,10 @@ void configuration_destroy(struct configuration *cfg)
 		threshold_destroy(t);
 	}
 
-	free(cfg);
+	if (cfg->destroy != NULL)
+		cfg->destroy(cfg);
+	else
+		free(cfg);
 }
 
 int configuration_add_threshold(struct configuration *cfg, struct threshold *n)
@@ -11,13 +11,26 @@ struct configuration {
 	struct threshold *current;
 	struct list unsatisfied;
 	struct list satisfied;
+	unsigned int interval;
+	struct watch_ticket *ticket;
+	/* entry in the shared state page, and the mode published there */
+	unsigned int state_idx;
+	const char *kind;
+
+	void (* run)(struct configuration *, int value);
+	void (* destroy)(struct configuration *);
+
 	struct list_node list_node;
 };
 
 void configuration_manager_add(struct configuration *cfg);
 void configuration_manager_run(void);
+void configuration_manager_foreach(void (* fn)(struct configuration *, void *),
+		void *data);
+void configuration_manager_check_allocs(void);
 
 struct configuration *configuration_create(const char *sensor);
+int configuration_init(struct configuration *cfg, const char *sensor);
 void configuration_destroy(struct configuration *cfg);
 int configuration_add_threshold(struct configuration *cfg, struct threshold *n);
 
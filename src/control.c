@@ -2,6 +2,9 @@
 #include <string.h>
 
 #include "log.h"
+#include "util.h"
+#include "watch.h"
+#include "recorder.h"
 #include "control.h"
 
 struct mitigation_level {
@@ -35,6 +38,14 @@ void control_manager_remove(struct control *ctrl)
 	list_remove(&g_control_manager_list, &ctrl->list_node);
 }
 
+void control_manager_foreach(void (* fn)(struct control *, void *), void *data)
+{
+	struct list_node *node;
+
+	for_list_node(&g_control_manager_list, node)
+		fn(list_entry(node, struct control, list_node), data);
+}
+
 struct control *control_create(const char *name)
 {
 	struct control *ctrl;
@@ -66,6 +77,23 @@ void control_destroy(struct control *ctrl)
 	free(ctrl);
 }
 
+/*
+ * Limits how often the level of a control may change.  A new level is
+ * held back until the current one has been in effect for min_dwell_ms,
+ * and until fewer than max_rate changes happened during the last second.
+ * A move to a higher level is never held back for more than
+ * max_escalation_delay_ms.
+ */
+void control_set_policy(struct control *ctrl, unsigned int min_dwell_ms,
+		unsigned int max_rate, unsigned int max_escalation_delay_ms)
+{
+	if (max_rate > CONTROL_MAX_RATE)
+		max_rate = CONTROL_MAX_RATE;
+	ctrl->min_dwell_ms = min_dwell_ms;
+	ctrl->max_rate = max_rate;
+	ctrl->max_escalation_delay_ms = max_escalation_delay_ms;
+}
+
 void control_add_mitigation(struct control *ctrl, struct mitigation *mitigation)
 {
 	struct mitigation_level *l;
@@ -77,24 +105,89 @@ void control_add_mitigation(struct control *ctrl, struct mitigation *mitigation)
 	list_append(&ctrl->mitigation_levels, &l->list_node);
 }
 
-static void control_update_level(struct control *ctrl)
+static void control_update_level(struct control *ctrl);
+
+static void control_deferred_cb(void *data, struct watch_ticket *ticket)
+{
+	struct control *ctrl = data;
+
+	watch_ticket_clear(ticket);
+	watch_ticket_set_null(ticket);
+	control_update_level(ctrl);
+}
+
+static struct watch_ticket *control_ticket(struct control *ctrl)
+{
+	if (ctrl->ticket == NULL) {
+		ctrl->ticket = watch_manager_add_null();
+		if (ctrl->ticket != NULL)
+			watch_ticket_callback(ctrl->ticket,
+					control_deferred_cb, ctrl);
+	}
+	return ctrl->ticket;
+}
+
+/*
+ * Creates the deferral tickets up front so that a level change in the
+ * main loop never has to allocate one.
+ */
+void control_manager_enable(void)
 {
-	struct mitigation_level *l;
 	struct list_node *node;
-	int level;
+	struct control *ctrl;
 
-	level = 0;
+	for_list_node(&g_control_manager_list, node) {
+		ctrl = list_entry(node, struct control, list_node);
+		if (ctrl->min_dwell_ms || ctrl->max_rate)
+			control_ticket(ctrl);
+	}
+}
 
-	for_list_node(&ctrl->mitigation_levels, node) {
-		l = list_entry(node, struct mitigation_level, list_node);
-		if (l->nvotes > 0 && l->mitigation->level > level)
-			level = l->mitigation->level;
+/* milliseconds the policy still holds back a change to level */
+static long long control_delay(struct control *ctrl, int level,
+		unsigned long long now)
+{
+	unsigned long long last;
+	long long delay = 0;
+	long long bound;
+	int oldest;
+
+	if (ctrl->current_level < 0)
+		return 0;
+
+	last = ctrl->changes[(ctrl->change_head + CONTROL_MAX_RATE - 1) %
+			CONTROL_MAX_RATE];
+	if (ctrl->min_dwell_ms && last)
+		delay = (long long)(last + ctrl->min_dwell_ms - now);
+
+	if (ctrl->max_rate) {
+		oldest = (ctrl->change_head + CONTROL_MAX_RATE -
+				ctrl->max_rate) % CONTROL_MAX_RATE;
+		if (ctrl->changes[oldest] &&
+				(long long)(ctrl->changes[oldest] + 1000 - now) >
+				delay)
+			delay = ctrl->changes[oldest] + 1000 - now;
 	}
 
-	if (level == ctrl->current_level)
-		return;
+	if (delay > 0 && level > ctrl->current_level) {
+		if (ctrl->pending_since == 0)
+			ctrl->pending_since = now;
+		bound = (long long)(ctrl->pending_since +
+				ctrl->max_escalation_delay_ms - now);
+		if (bound < delay)
+			delay = bound;
+	}
+
+	return delay;
+}
+
+static void control_apply_level(struct control *ctrl, int level)
+{
+	struct mitigation_level *l;
+	struct list_node *node;
 
 	LOGI("\"%s\" set to level %d\n", ctrl->name, level);
+	recorder_level(ctrl, level, ctrl->current_level);
 
 	for_list_node(&ctrl->mitigation_levels, node) {
 		l = list_entry(node, struct mitigation_level, list_node);
@@ -106,6 +199,51 @@ static void control_update_level(struct control *ctrl)
 	ctrl->current_level = level;
 }
 
+static void control_update_level(struct control *ctrl)
+{
+	struct mitigation_level *l;
+	struct list_node *node;
+	unsigned long long now;
+	long long delay;
+	int level;
+
+	level = 0;
+
+	for_list_node(&ctrl->mitigation_levels, node) {
+		l = list_entry(node, struct mitigation_level, list_node);
+		if (l->nvotes > 0 && l->mitigation->level > level)
+			level = l->mitigation->level;
+	}
+
+	if (level == ctrl->current_level) {
+		/* the level came back before a deferred change was applied */
+		if (ctrl->ticket != NULL)
+			watch_ticket_set_null(ctrl->ticket);
+		ctrl->pending_since = 0;
+		return;
+	}
+
+	if (ctrl->min_dwell_ms || ctrl->max_rate) {
+		now = util_time_ms();
+		delay = control_delay(ctrl, level, now);
+		if (delay > 0) {
+			if (control_ticket(ctrl) != NULL) {
+				LOGV("\"%s\" level %d deferred %lld ms\n",
+						ctrl->name, level, delay);
+				watch_ticket_set_timeout(ctrl->ticket, delay);
+				return;
+			}
+		}
+		if (ctrl->ticket != NULL)
+			watch_ticket_set_null(ctrl->ticket);
+		ctrl->pending_since = 0;
+		ctrl->changes[ctrl->change_head] = now;
+		ctrl->change_head = (ctrl->change_head + 1) % CONTROL_MAX_RATE;
+	}
+
+	control_apply_level(ctrl, level);
+}
+
 void control_vote_level(struct control *ctrl, int level)
 {
 	struct mitigation_level *l;
@@ -118,6 +256,7 @@ void control_vote_level(struct control *ctrl, int level)
 			break;
 		}
 	}
+	recorder_vote(ctrl, level, 1);
 	control_update_level(ctrl);
 }
 
@@ -134,5 +273,36 @@ void control_unvote_level(struct control *ctrl, int level)
 			break;
 		}
 	}
+	recorder_vote(ctrl, level, 0);
 	control_update_level(ctrl);
 }
+
+int control_max_level(struct control *ctrl)
+{
+	struct mitigation_level *l;
+	struct list_node *node;
+	int level = 0;
+
+	for_list_node(&ctrl->mitigation_levels, node) {
+		l = list_entry(node, struct mitigation_level, list_node);
+		if (l->mitigation->level > level)
+			level = l->mitigation->level;
+	}
+	return level;
+}
+
+/* highest level defined by the control that does not exceed level */
+int control_floor_level(struct control *ctrl, int level)
+{
+	struct mitigation_level *l;
+	struct list_node *node;
+	int floor = 0;
+
+	for_list_node(&ctrl->mitigation_levels, node) {
+		l = list_entry(node, struct mitigation_level, list_node);
+		if (l->mitigation->level <= level &&
+				l->mitigation->level > floor)
+			floor = l->mitigation->level;
+	}
+	return floor;
+}
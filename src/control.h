@@ -4,22 +4,48 @@
 #include "mitigation.h"
 #include "list.h"
 
+#define CONTROL_MAX_RATE 32
+
+struct watch_ticket;
+
 struct control {
 	char name[256];
 	int current_level;
 	struct list mitigation_levels;
+
+	/* level change policy, see control_set_policy() */
+	unsigned int min_dwell_ms;
+	unsigned int max_rate;
+	unsigned int max_escalation_delay_ms;
+	unsigned long long changes[CONTROL_MAX_RATE];
+	int change_head;
+	unsigned long long pending_since;
+	struct watch_ticket *ticket;
+
+	/* name index in the flight recorder, or 0 */
+	unsigned int record_id;
+	/* entry in the shared state page */
+	unsigned int state_idx;
+
 	struct list_node list_node;
 };
 
 struct control *control_manager_find(const char *name);
 void control_manager_add(struct control *ctrl);
 void control_manager_remove(struct control *ctrl);
+void control_manager_enable(void);
+void control_manager_foreach(void (* fn)(struct control *, void *),
+		void *data);
 
 struct control *control_create(const char *name);
 void control_destroy(struct control *ctrl);
 
+void control_set_policy(struct control *ctrl, unsigned int min_dwell_ms,
+		unsigned int max_rate, unsigned int max_escalation_delay_ms);
 void control_add_mitigation(struct control *ctrl, struct mitigation *m);
 void control_vote_level(struct control *ctrl, int level);
 void control_unvote_level(struct control *ctrl, int level);
+int control_max_level(struct control *ctrl);
+int control_floor_level(struct control *ctrl, int level);
 
 #endif
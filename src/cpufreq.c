@@ -4,15 +4,65 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
+#include <pthread.h>
 
+#include "log.h"
+#include "list.h"
+#include "util.h"
+#include "uevent.h"
+#include "freq_table.h"
 #include "cpufreq.h"
 
-struct cpufreq {
+#define CPU_DIR "/sys/devices/system/cpu"
+#define CPUFREQ_POLICY_DIR CPU_DIR "/cpufreq"
+
+/*
+ * CPUs sharing a clock are governed by a single cpufreq policy.  Every
+ * cpufreq opened for a CPU of the same policy shares one cpufreq_policy,
+ * so writing the same limit through several CPUs of a cluster in the same
+ * tick reaches the kernel only once.  The last limit written is not
+ * trusted across ticks, since the kernel or another service may have
+ * changed it since, nor after a CPU of the policy came online.
+ *
+ * When cpu hotplug events can be monitored, a policy whose CPUs are all
+ * offline is suspended: writes only update the requested limit, which is
+ * replayed once one of its CPUs comes back online.  On kernels without
+ * policyN directories the policy is reached through the cpufreq directory
+ * of one of its CPUs, which goes away with that CPU, so it is moved to
+ * another online CPU of the policy.
+ *
+ * Limits may be written from the actuator thread while hotplug events and
+ * reads are handled by the main loop, so a policy is accessed under its
+ * lock.
+ */
+struct cpufreq_policy {
+	pthread_mutex_t lock;
 	char dir[PATH_MAX];
+	/* CPU whose cpufreq directory dir is, or -1 for policyN */
+	int dir_cpu;
+	int id;
+	unsigned long cpus;
+	unsigned long online;
+	int suspended;
+	int refcount;
 	int max_freq_fd;
 	int cur_freq_fd;
+	unsigned int max_freq;
+	unsigned int max_freq_tick;
+	int max_freq_written;
+	unsigned int cpuinfo_max_freq;
+	struct freq_table table;
+	struct list_node list_node;
+};
+
+struct cpufreq {
+	struct cpufreq_policy *policy;
 };
 
+static LIST(g_cpufreq_policy_list);
+static int g_cpufreq_hotplug = -1;
+static unsigned int g_cpufreq_tick;
+
 static int cpufreq_open_file(const char *dir, const char *file, int mode)
 {
 	char fname[PATH_MAX];
@@ -20,33 +70,267 @@ static int cpufreq_open_file(const char *dir, const char *file, int mode)
 	return open(fname, mode);
 }
 
-static int cpufreq_open_max(struct cpufreq *cf)
+static int cpufreq_read_file(const char *dir, const char *file,
+		char *buf, unsigned int len)
+{
+	char fname[PATH_MAX];
+	snprintf(fname, sizeof(fname), "%s/%s", dir, file);
+	return util_read_file(fname, buf, len);
+}
+
+static int cpufreq_open_max(struct cpufreq_policy *p)
 {
 	int rc;
 
-	if (cf->max_freq_fd == -1) {
-		rc = cpufreq_open_file(cf->dir, "scaling_max_freq", O_RDWR);
+	if (p->max_freq_fd == -1) {
+		rc = cpufreq_open_file(p->dir, "scaling_max_freq", O_RDWR);
 		if (rc == -1)
 			return -1;
-		cf->max_freq_fd = rc;
+		p->max_freq_fd = rc;
 	}
 
 	return 0;
 }
 
-static int cpufreq_open_cur(struct cpufreq *cf)
+static int cpufreq_open_cur(struct cpufreq_policy *p)
 {
 	int rc;
 
-	if (cf->cur_freq_fd == -1) {
-		rc = cpufreq_open_file(cf->dir, "scaling_cur_freq", O_RDONLY);
+	if (p->cur_freq_fd == -1) {
+		rc = cpufreq_open_file(p->dir, "scaling_cur_freq", O_RDONLY);
 		if (rc == -1)
 			return -1;
-		cf->cur_freq_fd = rc;
+		p->cur_freq_fd = rc;
 	}
 	return 0;
 }
 
+static int cpufreq_read_cpus(const char *dir, unsigned long *cpus)
+{
+	char buf[256];
+
+	if (cpufreq_read_file(dir, "related_cpus", buf, sizeof(buf)) <= 0 &&
+			cpufreq_read_file(dir, "affected_cpus",
+				buf, sizeof(buf)) <= 0)
+		return -1;
+	if (util_parse_cpulist(buf, cpus) || *cpus == 0)
+		return -1;
+	return 0;
+}
+
+static int cpufreq_read_online(unsigned long *online)
+{
+	char buf[256];
+
+	if (cpufreq_read_file(CPU_DIR, "online", buf, sizeof(buf)) <= 0)
+		return -1;
+	return util_parse_cpulist(buf, online);
+}
+
+static void cpufreq_policy_close_fds(struct cpufreq_policy *p)
+{
+	if (p->max_freq_fd != -1)
+		close(p->max_freq_fd);
+	if (p->cur_freq_fd != -1)
+		close(p->cur_freq_fd);
+	p->max_freq_fd = -1;
+	p->cur_freq_fd = -1;
+}
+
+static int cpufreq_policy_write_max(struct cpufreq_policy *p);
+
+static void cpufreq_policy_suspend(struct cpufreq_policy *p)
+{
+	if (p->suspended)
+		return;
+	LOGI("%s: all cpus offline, suspending\n", p->dir);
+	cpufreq_policy_close_fds(p);
+	p->max_freq_written = 0;
+	p->suspended = 1;
+}
+
+static void cpufreq_policy_rehome(struct cpufreq_policy *p)
+{
+	int cpu;
+
+	if (p->dir_cpu < 0 || p->online == 0 ||
+			(p->online & (1UL << p->dir_cpu)))
+		return;
+
+	cpu = __builtin_ctzl(p->online);
+	cpufreq_policy_close_fds(p);
+	snprintf(p->dir, sizeof(p->dir), CPU_DIR "/cpu%d/cpufreq", cpu);
+	LOGI("cpu%d offline, using %s\n", p->dir_cpu, p->dir);
+	p->dir_cpu = cpu;
+	p->max_freq_written = 0;
+}
+
+static void cpufreq_policy_resume(struct cpufreq_policy *p)
+{
+	if (!p->suspended)
+		return;
+	LOGI("%s: cpus online, restoring limit %u\n", p->dir, p->max_freq);
+	p->suspended = 0;
+	if (p->max_freq)
+		cpufreq_policy_write_max(p);
+}
+
+static void cpufreq_hotplug_cb(void *data __attribute__ ((__unused__)),
+		const char *action, const char *devpath)
+{
+	struct cpufreq_policy *p;
+	struct list_node *node;
+	unsigned long cpu;
+	int online;
+
+	if (!strcmp(action, "online"))
+		online = 1;
+	else if (!strcmp(action, "offline"))
+		online = 0;
+	else
+		return;
+
+	if (strncmp(devpath, "/devices/system/cpu/cpu", 23) ||
+			devpath[23] < '0' || devpath[23] > '9')
+		return;
+	cpu = strtoul(devpath + 23, 0, 10);
+	if (cpu >= sizeof(p->cpus) * 8)
+		return;
+
+	for_list_node(&g_cpufreq_policy_list, node) {
+		p = list_entry(node, struct cpufreq_policy, list_node);
+		if (!(p->cpus & (1UL << cpu)))
+			continue;
+
+		pthread_mutex_lock(&p->lock);
+		if (online) {
+			p->online |= 1UL << cpu;
+			p->max_freq_written = 0;
+			cpufreq_policy_rehome(p);
+			cpufreq_policy_resume(p);
+		} else {
+			p->online &= ~(1UL << cpu);
+			if (p->online == 0)
+				cpufreq_policy_suspend(p);
+			else
+				cpufreq_policy_rehome(p);
+		}
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+static void cpufreq_policy_update_online(struct cpufreq_policy *p)
+{
+	unsigned long online;
+
+	if (p->cpus == 0 || cpufreq_read_online(&online))
+		return;
+
+	p->online = p->cpus & online;
+	if (p->online == 0)
+		cpufreq_policy_suspend(p);
+	else
+		cpufreq_policy_rehome(p);
+}
+
+/*
+ * Called after an access failed.  If the policy has gone offline, stop
+ * touching it until a hotplug event brings it back.
+ */
+static void cpufreq_policy_check_online(struct cpufreq_policy *p)
+{
+	if (g_cpufreq_hotplug != 0)
+		cpufreq_policy_update_online(p);
+}
+
+static struct cpufreq_policy *cpufreq_policy_get(const char *dir)
+{
+	struct cpufreq_policy *p;
+	struct list_node *node;
+	char fname[PATH_MAX];
+	unsigned long cpus;
+	int cpu;
+	int id;
+
+	if (g_cpufreq_hotplug == -1)
+		g_cpufreq_hotplug = uevent_listener_add("cpu",
+				cpufreq_hotplug_cb, NULL);
+
+	id = -1;
+	if (cpufreq_read_cpus(dir, &cpus) == 0) {
+		id = __builtin_ctzl(cpus);
+		for_list_node(&g_cpufreq_policy_list, node) {
+			p = list_entry(node, struct cpufreq_policy, list_node);
+			if (p->id == id) {
+				p->refcount++;
+				return p;
+			}
+		}
+	} else {
+		cpus = 0;
+	}
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return NULL;
+
+	pthread_mutex_init(&p->lock, NULL);
+	p->id = id;
+	p->cpus = cpus;
+	p->online = cpus;
+	p->refcount = 1;
+	p->max_freq_fd = -1;
+	p->cur_freq_fd = -1;
+	p->dir_cpu = -1;
+
+	snprintf(fname, sizeof(fname), CPUFREQ_POLICY_DIR
+			"/policy%d/scaling_max_freq", id);
+	if (id >= 0 && access(fname, F_OK) == 0)
+		snprintf(p->dir, sizeof(p->dir), CPUFREQ_POLICY_DIR
+				"/policy%d", id);
+	else
+		snprintf(p->dir, sizeof(p->dir), "%s", dir);
+
+	if (strcmp(p->dir, dir) == 0 &&
+			sscanf(dir, CPU_DIR "/cpu%d/cpufreq", &cpu) == 1 &&
+			cpu >= 0 && cpu < (int)sizeof(cpus) * 8 &&
+			(cpus & (1UL << cpu)))
+		p->dir_cpu = cpu;
+	/* hotplug events only report changes from here on */
+	cpufreq_policy_update_online(p);
+
+	if (id >= 0)
+		LOGV("%s: cpufreq policy %d, cpus 0x%lx\n", dir, id, cpus);
+
+	if (freq_table_load(&p->table, p->dir,
+			"scaling_available_frequencies") == 0) {
+		LOGV("%s: %d available frequencies, %lu - %lu\n", p->dir,
+				p->table.count, p->table.freqs[0],
+				p->table.freqs[p->table.count - 1]);
+	} else {
+		char buf[32];
+
+		if (cpufreq_read_file(p->dir, "cpuinfo_max_freq",
+				buf, sizeof(buf)) > 0)
+			p->cpuinfo_max_freq = strtoul(buf, 0, 0);
+	}
+
+	list_append(&g_cpufreq_policy_list, &p->list_node);
+	return p;
+}
+
+static void cpufreq_policy_put(struct cpufreq_policy *p)
+{
+	if (--p->refcount > 0)
+		return;
+
+	list_remove(&g_cpufreq_policy_list, &p->list_node);
+	cpufreq_policy_close_fds(p);
+	freq_table_free(&p->table);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
 struct cpufreq *cpufreq_open(const char *dir)
 {
 	struct cpufreq *cf;
@@ -55,40 +339,41 @@ struct cpufreq *cpufreq_open(const char *dir)
 	if (cf == NULL)
 		return NULL;
 
-	strncpy(cf->dir, dir, sizeof(cf->dir));
-	cf->dir[sizeof(cf->dir) - 1] = 0;
-
-	cf->max_freq_fd = -1;
-	cf->cur_freq_fd = -1;
+	cf->policy = cpufreq_policy_get(dir);
+	if (cf->policy == NULL) {
+		free(cf);
+		return NULL;
+	}
 
 	return cf;
 }
 
 void cpufreq_close(struct cpufreq *cf)
 {
-	if (cf->max_freq_fd != -1)
-		close(cf->max_freq_fd);
-	if (cf->cur_freq_fd != -1)
-		close(cf->cur_freq_fd);
+	cpufreq_policy_put(cf->policy);
 	free(cf);
 }
 
-int cpufreq_read_max(struct cpufreq *cf, unsigned int *value)
+static int cpufreq_read_max_locked(struct cpufreq_policy *p,
+		unsigned int *value)
 {
 	char buf[32];
 	int rc;
 
-	if (value == NULL)
+	if (value == NULL || p->suspended)
 		return -1;
-	rc = cpufreq_open_max(cf);
-	if (rc)
+	rc = cpufreq_open_max(p);
+	if (rc) {
+		cpufreq_policy_check_online(p);
 		return -1;
+	}
 
-	rc = read(cf->max_freq_fd, buf, sizeof(buf));
-	lseek(cf->max_freq_fd, 0, SEEK_SET);
+	rc = read(p->max_freq_fd, buf, sizeof(buf));
+	lseek(p->max_freq_fd, 0, SEEK_SET);
 	if (rc <= 0) {
-		close(cf->max_freq_fd);
-		cf->max_freq_fd = -1;
+		close(p->max_freq_fd);
+		p->max_freq_fd = -1;
+		cpufreq_policy_check_online(p);
 		return -1;
 	}
 
@@ -96,46 +381,139 @@ int cpufreq_read_max(struct cpufreq *cf, unsigned int *value)
 	return 0;
 }
 
-int cpufreq_write_max(struct cpufreq *cf, unsigned int value)
+int cpufreq_read_max(struct cpufreq *cf, unsigned int *value)
+{
+	struct cpufreq_policy *p = cf->policy;
+	int rc;
+
+	pthread_mutex_lock(&p->lock);
+	rc = cpufreq_read_max_locked(p, value);
+	pthread_mutex_unlock(&p->lock);
+	return rc;
+}
+
+static int cpufreq_policy_write_max(struct cpufreq_policy *p)
 {
 	char buf[32];
 	int rc;
 
-	rc = cpufreq_open_max(cf);
+	rc = cpufreq_open_max(p);
 	if (rc)
-		return -1;
-	rc = snprintf(buf, sizeof(buf), "%u", value);
-	rc = write(cf->max_freq_fd, buf, rc);
-	lseek(cf->max_freq_fd, 0, SEEK_SET);
+		goto fail;
+	rc = snprintf(buf, sizeof(buf), "%u", p->max_freq);
+	rc = write(p->max_freq_fd, buf, rc);
+	lseek(p->max_freq_fd, 0, SEEK_SET);
 	if (rc <= 0) {
-		close(cf->max_freq_fd);
-		cf->max_freq_fd = -1;
-		return -1;
+		close(p->max_freq_fd);
+		p->max_freq_fd = -1;
+		goto fail;
 	}
+	p->max_freq_written = 1;
+	return 0;
 
-	return -(rc <= 0);
+fail:
+	p->max_freq_written = 0;
+	cpufreq_policy_check_online(p);
+	return -(p->suspended == 0);
 }
 
-int cpufreq_read_cur(struct cpufreq *cf, unsigned int *value)
+/*
+ * Starts a new tick, limits written before are written again.  Called from
+ * the main loop while writes may come from the actuator thread.
+ */
+void cpufreq_tick(void)
+{
+	__atomic_add_fetch(&g_cpufreq_tick, 1, __ATOMIC_RELAXED);
+}
+
+int cpufreq_write_max(struct cpufreq *cf, unsigned int value)
+{
+	struct cpufreq_policy *p = cf->policy;
+	unsigned int tick;
+	int rc = 0;
+
+	value = freq_table_snap(&p->table, value);
+	tick = __atomic_load_n(&g_cpufreq_tick, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&p->lock);
+	if (value != p->max_freq || !p->max_freq_written ||
+			tick != p->max_freq_tick) {
+		p->max_freq = value;
+		p->max_freq_tick = tick;
+		if (!p->suspended)
+			rc = cpufreq_policy_write_max(p);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return rc;
+}
+
+static int cpufreq_read_cur_locked(struct cpufreq_policy *p,
+		unsigned int *value)
 {
 	char buf[32];
 	int rc;
 
-	if (value == NULL)
+	if (value == NULL || p->suspended)
 		return -1;
 
-	rc = cpufreq_open_cur(cf);
-	if (rc)
+	rc = cpufreq_open_cur(p);
+	if (rc) {
+		cpufreq_policy_check_online(p);
 		return -1;
+	}
 
-	rc = read(cf->cur_freq_fd, buf, sizeof(buf));
-	lseek(cf->cur_freq_fd, 0, SEEK_SET);
+	rc = read(p->cur_freq_fd, buf, sizeof(buf));
+	lseek(p->cur_freq_fd, 0, SEEK_SET);
 	if (rc <= 0) {
-		close(cf->cur_freq_fd);
-		cf->cur_freq_fd = -1;
+		close(p->cur_freq_fd);
+		p->cur_freq_fd = -1;
+		cpufreq_policy_check_online(p);
 		return -1;
 	}
 
 	*value = strtol(buf, 0, 0);
 	return 0;
 }
+
+int cpufreq_read_cur(struct cpufreq *cf, unsigned int *value)
+{
+	struct cpufreq_policy *p = cf->policy;
+	int rc;
+
+	pthread_mutex_lock(&p->lock);
+	rc = cpufreq_read_cur_locked(p, value);
+	pthread_mutex_unlock(&p->lock);
+	return rc;
+}
+
+unsigned int cpufreq_snap(struct cpufreq *cf, unsigned int value)
+{
+	return freq_table_snap(&cf->policy->table, value);
+}
+
+int cpufreq_resolve_index(struct cpufreq *cf, int index, unsigned int *value)
+{
+	unsigned long freq;
+
+	if (freq_table_index(&cf->policy->table, index, &freq))
+		return -1;
+	*value = freq;
+	return 0;
+}
+
+int cpufreq_resolve_percent(struct cpufreq *cf, int percent,
+		unsigned int *value)
+{
+	struct cpufreq_policy *p = cf->policy;
+	unsigned long freq;
+
+	if (freq_table_percent(&p->table, percent, &freq) == 0) {
+		*value = freq;
+		return 0;
+	}
+	if (p->cpuinfo_max_freq == 0 || percent < 0)
+		return -1;
+	*value = (unsigned long long)p->cpuinfo_max_freq * percent / 100;
+	return 0;
+}
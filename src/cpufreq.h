@@ -9,5 +9,11 @@ void cpufreq_close(struct cpufreq *cf);
 int cpufreq_read_cur(struct cpufreq *cf, unsigned int *value);
 int cpufreq_read_max(struct cpufreq *cf, unsigned int *value);
 int cpufreq_write_max(struct cpufreq *cf, unsigned int value);
+void cpufreq_tick(void);
+
+unsigned int cpufreq_snap(struct cpufreq *cf, unsigned int value);
+int cpufreq_resolve_index(struct cpufreq *cf, int index, unsigned int *value);
+int cpufreq_resolve_percent(struct cpufreq *cf, int percent,
+		unsigned int *value);
 
 #endif
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "log.h"
+#include "resource.h"
+#include "actuator.h"
+#include "curve.h"
+
+#define ABS(x) (((x)<0)?-(x):(x))
+
+struct curve_point {
+	int input;
+	int output;
+};
+
+/*
+ * A curve maps its sensor value onto a resource by linear interpolation
+ * between points, instead of stepping through threshold levels.  It is
+ * evaluated on every sample, and the output is only written when it moves
+ * by more than the deadband.
+ */
+struct curve {
+	struct configuration configuration;
+	struct resource *resource;
+	struct curve_point *points;
+	int npoints;
+	int deadband;
+	int output;
+	int enabled;
+};
+
+static int curve_interpolate(struct curve *c, int value)
+{
+	struct curve_point *lo, *hi;
+	int i;
+
+	if (value <= c->points[0].input)
+		return c->points[0].output;
+	if (value >= c->points[c->npoints - 1].input)
+		return c->points[c->npoints - 1].output;
+
+	for (i = 1; value > c->points[i].input; ++i)
+		;
+	lo = &c->points[i - 1];
+	hi = &c->points[i];
+
+	return lo->output + (long long)(hi->output - lo->output) *
+			(value - lo->input) / (hi->input - lo->input);
+}
+
+static void curve_run(struct configuration *cfg, int value)
+{
+	struct curve *c = container_of(cfg, struct curve, configuration);
+	int output;
+
+	if (c->npoints == 0)
+		return;
+
+	cfg->last_value = value;
+	output = curve_interpolate(c, value);
+	if (c->enabled && output == c->output)
+		return;
+
+	/* always settle on the end points, whatever the deadband */
+	if (c->enabled && ABS(output - c->output) <= c->deadband &&
+			output != c->points[0].output &&
+			output != c->points[c->npoints - 1].output)
+		return;
+
+	if (!c->enabled) {
+		resource_enable(c->resource);
+		c->enabled = 1;
+	}
+	c->output = output;
+	actuator_write_int(c->resource, output);
+}
+
+static void curve_destroy(struct configuration *cfg)
+{
+	struct curve *c = container_of(cfg, struct curve, configuration);
+
+	if (c->enabled)
+		resource_disable(c->resource);
+	free(c->points);
+	free(c);
+}
+
+struct configuration *curve_create(const char *sensor, const char *resource,
+		int deadband, unsigned int interval)
+{
+	struct curve *c;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return NULL;
+
+	if (configuration_init(&c->configuration, sensor)) {
+		free(c);
+		return NULL;
+	}
+	c->resource = resource_manager_find(resource);
+	if (c->resource == NULL) {
+		free(c);
+		return NULL;
+	}
+
+	c->deadband = deadband;
+	c->configuration.interval = interval;
+	c->configuration.kind = "curve";
+	c->configuration.run = curve_run;
+	c->configuration.destroy = curve_destroy;
+
+	return &c->configuration;
+}
+
+int curve_add_point(struct configuration *cfg, int input, int output)
+{
+	struct curve *c = container_of(cfg, struct curve, configuration);
+	struct curve_point *points;
+	int i;
+
+	points = realloc(c->points, sizeof(c->points[0]) * (c->npoints + 1));
+	if (points == NULL)
+		return -1;
+	c->points = points;
+
+	/* sort insert, points with equal inputs are replaced */
+	for (i = 0; i < c->npoints && points[i].input < input; ++i)
+		;
+	if (i < c->npoints && points[i].input == input) {
+		points[i].output = output;
+		return 0;
+	}
+	memmove(&points[i + 1], &points[i],
+			(c->npoints - i) * sizeof(points[0]));
+	points[i].input = input;
+	points[i].output = output;
+	c->npoints++;
+
+	return 0;
+}
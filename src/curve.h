@@ -0,0 +1,10 @@
+#ifndef _CURVE_H_
+#define _CURVE_H_
+
+#include "configuration.h"
+
+struct configuration *curve_create(const char *sensor, const char *resource,
+		int deadband, unsigned int interval);
+int curve_add_point(struct configuration *cfg, int input, int output);
+
+#endif
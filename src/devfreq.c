@@ -0,0 +1,144 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "log.h"
+#include "freq_table.h"
+#include "devfreq.h"
+
+#define DEVFREQ_CLASS_DIR "/sys/class/devfreq"
+
+/*
+ * The last limit written is only trusted within one tick, since the
+ * governor, the thermal framework or another service may change max_freq
+ * behind our back.
+ */
+struct devfreq {
+	char dir[PATH_MAX];
+	int max_freq_fd;
+	int cur_freq_fd;
+	unsigned long max_freq;
+	unsigned int max_freq_tick;
+	int max_freq_written;
+	struct freq_table table;
+};
+
+static unsigned int g_devfreq_tick;
+
+static int devfreq_open_file(const char *dir, const char *file, int mode)
+{
+	char fname[PATH_MAX];
+	snprintf(fname, sizeof(fname), "%s/%s", dir, file);
+	return open(fname, mode);
+}
+
+/*
+ * dir is either a devfreq device directory or the name of a device
+ * below /sys/class/devfreq.
+ */
+struct devfreq *devfreq_open(const char *dir)
+{
+	struct devfreq *df;
+
+	df = calloc(1, sizeof(*df));
+	if (df == NULL)
+		return NULL;
+
+	if (strchr(dir, '/') == NULL)
+		snprintf(df->dir, sizeof(df->dir), DEVFREQ_CLASS_DIR "/%s", dir);
+	else
+		snprintf(df->dir, sizeof(df->dir), "%s", dir);
+
+	df->max_freq_fd = devfreq_open_file(df->dir, "max_freq", O_RDWR);
+	if (df->max_freq_fd == -1) {
+		free(df);
+		return NULL;
+	}
+	df->cur_freq_fd = devfreq_open_file(df->dir, "cur_freq", O_RDONLY);
+	/* failure ok */
+
+	if (freq_table_load(&df->table, df->dir, "available_frequencies") == 0)
+		LOGV("%s: %d available frequencies, %lu - %lu\n", df->dir,
+				df->table.count, df->table.freqs[0],
+				df->table.freqs[df->table.count - 1]);
+
+	return df;
+}
+
+void devfreq_close(struct devfreq *df)
+{
+	if (df->max_freq_fd != -1)
+		close(df->max_freq_fd);
+	if (df->cur_freq_fd != -1)
+		close(df->cur_freq_fd);
+	freq_table_free(&df->table);
+	free(df);
+}
+
+int devfreq_read_cur(struct devfreq *df, unsigned long *value)
+{
+	char buf[32];
+	int rc;
+
+	if (df->cur_freq_fd == -1)
+		return -1;
+
+	rc = read(df->cur_freq_fd, buf, sizeof(buf) - 1);
+	lseek(df->cur_freq_fd, 0, SEEK_SET);
+	if (rc <= 0)
+		return -1;
+
+	buf[rc] = 0;
+	*value = strtoul(buf, 0, 0);
+	return 0;
+}
+
+/*
+ * Starts a new tick, limits written before are written again.  Called from
+ * the main loop while writes may come from the actuator thread.
+ */
+void devfreq_tick(void)
+{
+	__atomic_add_fetch(&g_devfreq_tick, 1, __ATOMIC_RELAXED);
+}
+
+int devfreq_write_max(struct devfreq *df, unsigned long value)
+{
+	unsigned int tick;
+	char buf[32];
+	int rc;
+
+	value = freq_table_snap(&df->table, value);
+	tick = __atomic_load_n(&g_devfreq_tick, __ATOMIC_RELAXED);
+	if (value == df->max_freq && df->max_freq_written &&
+			tick == df->max_freq_tick)
+		return 0;
+
+	rc = snprintf(buf, sizeof(buf), "%lu", value);
+	rc = write(df->max_freq_fd, buf, rc);
+	lseek(df->max_freq_fd, 0, SEEK_SET);
+
+	df->max_freq = value;
+	df->max_freq_tick = tick;
+	df->max_freq_written = rc > 0;
+	return -(rc <= 0);
+}
+
+unsigned long devfreq_snap(struct devfreq *df, unsigned long value)
+{
+	return freq_table_snap(&df->table, value);
+}
+
+int devfreq_resolve_index(struct devfreq *df, int index, unsigned long *value)
+{
+	return freq_table_index(&df->table, index, value);
+}
+
+int devfreq_resolve_percent(struct devfreq *df, int percent,
+		unsigned long *value)
+{
+	return freq_table_percent(&df->table, percent, value);
+}
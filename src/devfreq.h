@@ -0,0 +1,19 @@
+#ifndef _DEVFREQ_H_
+#define _DEVFREQ_H_
+
+struct devfreq;
+
+struct devfreq *devfreq_open(const char *dir);
+void devfreq_close(struct devfreq *df);
+
+int devfreq_read_cur(struct devfreq *df, unsigned long *value);
+int devfreq_write_max(struct devfreq *df, unsigned long value);
+void devfreq_tick(void);
+
+unsigned long devfreq_snap(struct devfreq *df, unsigned long value);
+int devfreq_resolve_index(struct devfreq *df, int index,
+		unsigned long *value);
+int devfreq_resolve_percent(struct devfreq *df, int percent,
+		unsigned long *value);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "util.h"
+#include "freq_table.h"
+
+static int freq_table_cmp(const void *a, const void *b)
+{
+	unsigned long fa = *(const unsigned long *)a;
+	unsigned long fb = *(const unsigned long *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+ * Loads a list of supported frequencies such as
+ * scaling_available_frequencies.  The kernel does not agree on an order
+ * between drivers, so the table is sorted ascending and duplicates dropped.
+ */
+int freq_table_load(struct freq_table *t, const char *dir, const char *file)
+{
+	char fname[PATH_MAX];
+	char buf[4096];
+	unsigned long *freqs;
+	char *p, *end;
+	int count;
+	int i;
+
+	t->freqs = NULL;
+	t->count = 0;
+
+	snprintf(fname, sizeof(fname), "%s/%s", dir, file);
+	if (util_read_file(fname, buf, sizeof(buf)) <= 0)
+		return -1;
+
+	count = 0;
+	for (p = buf; *p; ) {
+		strtoul(p, &end, 10);
+		if (end == p) {
+			++p;
+			continue;
+		}
+		count++;
+		p = end;
+	}
+	if (count == 0)
+		return -1;
+
+	freqs = calloc(count, sizeof(freqs[0]));
+	if (freqs == NULL)
+		return -1;
+
+	count = 0;
+	for (p = buf; *p; ) {
+		unsigned long freq = strtoul(p, &end, 10);
+		if (end == p) {
+			++p;
+			continue;
+		}
+		freqs[count++] = freq;
+		p = end;
+	}
+
+	qsort(freqs, count, sizeof(freqs[0]), freq_table_cmp);
+	for (i = 1; i < count; ) {
+		if (freqs[i] == freqs[i - 1]) {
+			memmove(&freqs[i], &freqs[i + 1],
+					(count - (i + 1)) * sizeof(freqs[0]));
+			--count;
+		} else {
+			++i;
+		}
+	}
+
+	t->freqs = freqs;
+	t->count = count;
+	return 0;
+}
+
+void freq_table_free(struct freq_table *t)
+{
+	free(t->freqs);
+	t->freqs = NULL;
+	t->count = 0;
+}
+
+/*
+ * Returns the highest supported frequency not above target, or the lowest
+ * supported frequency if target is below all of them.
+ */
+unsigned long freq_table_snap(const struct freq_table *t, unsigned long target)
+{
+	int lo, hi, mid;
+
+	if (t->count == 0)
+		return target;
+	if (target <= t->freqs[0])
+		return t->freqs[0];
+
+	lo = 0;
+	hi = t->count - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (t->freqs[mid] <= target)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return t->freqs[lo];
+}
+
+/*
+ * Index 0 is the lowest frequency, negative indexes count down from the
+ * highest one (-1).  Out of range indexes are clamped to the table.
+ */
+int freq_table_index(const struct freq_table *t, int index,
+		unsigned long *freq)
+{
+	if (t->count == 0)
+		return -1;
+
+	if (index < 0)
+		index += t->count;
+	if (index < 0)
+		index = 0;
+	if (index >= t->count)
+		index = t->count - 1;
+
+	*freq = t->freqs[index];
+	return 0;
+}
+
+int freq_table_percent(const struct freq_table *t, int percent,
+		unsigned long *freq)
+{
+	if (t->count == 0)
+		return -1;
+
+	if (percent < 0)
+		percent = 0;
+	*freq = freq_table_snap(t,
+			(unsigned long long)t->freqs[t->count - 1] * percent / 100);
+	return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _FREQ_TABLE_H_
+#define _FREQ_TABLE_H_
+
+struct freq_table {
+	unsigned long *freqs;
+	int count;
+};
+
+int freq_table_load(struct freq_table *t, const char *dir,
+		const char *file);
+void freq_table_free(struct freq_table *t);
+
+unsigned long freq_table_snap(const struct freq_table *t,
+		unsigned long target);
+int freq_table_index(const struct freq_table *t, int index,
+		unsigned long *freq);
+int freq_table_percent(const struct freq_table *t, int percent,
+		unsigned long *freq);
+
+#endif
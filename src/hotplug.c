@@ -0,0 +1,224 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "log.h"
+#include "util.h"
+#include "uevent.h"
+#include "hotplug.h"
+
+#define CPU_DIR "/sys/devices/system/cpu"
+#define HOTPLUG_MAX_CPUS (sizeof(unsigned long) * 8)
+
+/*
+ * Parks (offlines) a subset of the managed cpus.  The online state of every
+ * cpu is cached, and kept up to date through hotplug uevents, so only cpus
+ * that change are written.  The last online cpu of a cluster is never
+ * parked.
+ *
+ * The online mask is updated atomically, as parking may run on the
+ * actuator thread while uevents are handled by the main loop.
+ */
+struct hotplug {
+	unsigned long cpus;
+	unsigned long online;
+	unsigned long clusters[HOTPLUG_MAX_CPUS];
+	int nclusters;
+	int fds[HOTPLUG_MAX_CPUS];
+	unsigned long long last_latency_us;
+	unsigned long long max_latency_us;
+};
+
+static int hotplug_read_cpu_list(int cpu, const char *file,
+		unsigned long *mask)
+{
+	char fname[PATH_MAX];
+	char buf[256];
+
+	snprintf(fname, sizeof(fname), CPU_DIR "/cpu%d/%s", cpu, file);
+	if (util_read_file(fname, buf, sizeof(buf)) <= 0)
+		return -1;
+	if (util_parse_cpulist(buf, mask) || *mask == 0)
+		return -1;
+	return 0;
+}
+
+static void hotplug_add_cluster(struct hotplug *hp, int cpu)
+{
+	unsigned long mask;
+	int i;
+
+	for (i = 0; i < hp->nclusters; ++i) {
+		if (hp->clusters[i] & (1UL << cpu))
+			return;
+	}
+
+	if (hotplug_read_cpu_list(cpu, "topology/cluster_cpus_list", &mask) &&
+			hotplug_read_cpu_list(cpu,
+				"topology/core_siblings_list", &mask) &&
+			hotplug_read_cpu_list(cpu,
+				"cpufreq/related_cpus", &mask))
+		mask = 1UL << cpu;
+
+	hp->clusters[hp->nclusters++] = mask | (1UL << cpu);
+}
+
+static void hotplug_uevent_cb(void *data, const char *action,
+		const char *devpath)
+{
+	struct hotplug *hp = (struct hotplug *)data;
+	unsigned long cpu;
+
+	if (strncmp(devpath, "/devices/system/cpu/cpu", 23) ||
+			devpath[23] < '0' || devpath[23] > '9')
+		return;
+	cpu = strtoul(devpath + 23, 0, 10);
+	if (cpu >= HOTPLUG_MAX_CPUS)
+		return;
+
+	if (!strcmp(action, "online"))
+		__atomic_fetch_or(&hp->online, 1UL << cpu, __ATOMIC_RELAXED);
+	else if (!strcmp(action, "offline"))
+		__atomic_fetch_and(&hp->online, ~(1UL << cpu),
+				__ATOMIC_RELAXED);
+}
+
+struct hotplug *hotplug_open(unsigned long cpus)
+{
+	char fname[PATH_MAX];
+	char buf[256];
+	struct hotplug *hp;
+	unsigned long present;
+	unsigned int cpu;
+
+	hp = calloc(1, sizeof(*hp));
+	if (hp == NULL)
+		return NULL;
+
+	if (util_read_file(CPU_DIR "/present", buf, sizeof(buf)) <= 0 ||
+			util_parse_cpulist(buf, &present) ||
+			util_read_file(CPU_DIR "/online", buf, sizeof(buf)) <= 0 ||
+			util_parse_cpulist(buf, &hp->online)) {
+		free(hp);
+		return NULL;
+	}
+
+	for (cpu = 0; cpu < HOTPLUG_MAX_CPUS; ++cpu) {
+		hp->fds[cpu] = -1;
+		if (!(present & (1UL << cpu)))
+			continue;
+
+		hotplug_add_cluster(hp, cpu);
+		if (!(cpus & (1UL << cpu)))
+			continue;
+
+		snprintf(fname, sizeof(fname), CPU_DIR "/cpu%u/online", cpu);
+		hp->fds[cpu] = open(fname, O_RDWR);
+		if (hp->fds[cpu] == -1) {
+			LOGW("cpu%u can not be hotplugged\n", cpu);
+			continue;
+		}
+		hp->cpus |= 1UL << cpu;
+	}
+
+	if (hp->cpus == 0) {
+		free(hp);
+		return NULL;
+	}
+
+	uevent_listener_add("cpu", hotplug_uevent_cb, hp);
+
+	return hp;
+}
+
+void hotplug_close(struct hotplug *hp)
+{
+	unsigned int cpu;
+
+	uevent_listener_remove(hotplug_uevent_cb, hp);
+	for (cpu = 0; cpu < HOTPLUG_MAX_CPUS; ++cpu) {
+		if (hp->fds[cpu] != -1)
+			close(hp->fds[cpu]);
+	}
+	free(hp);
+}
+
+static int hotplug_set_cpu(struct hotplug *hp, unsigned int cpu, int online)
+{
+	unsigned long long start;
+	int rc;
+
+	start = util_time_us();
+	rc = write(hp->fds[cpu], online ? "1" : "0", 1);
+	lseek(hp->fds[cpu], 0, SEEK_SET);
+	if (rc <= 0) {
+		LOGW("failed to %s cpu%u\n", online ? "online" : "offline", cpu);
+		return -1;
+	}
+
+	hp->last_latency_us = util_time_us() - start;
+	if (hp->last_latency_us > hp->max_latency_us)
+		hp->max_latency_us = hp->last_latency_us;
+	LOGI("cpu%u %s in %lluus (max %lluus)\n", cpu,
+			online ? "online" : "offline",
+			hp->last_latency_us, hp->max_latency_us);
+
+	if (online)
+		__atomic_fetch_or(&hp->online, 1UL << cpu, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_and(&hp->online, ~(1UL << cpu),
+				__ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * Parks the managed cpus in parked and unparks the others.  Cpus are
+ * brought online first, lowest first, so capacity is added before any is
+ * removed, then parked highest first.
+ */
+int hotplug_park(struct hotplug *hp, unsigned long parked)
+{
+	unsigned long current;
+	unsigned long online;
+	unsigned long mask;
+	unsigned int cpu;
+	int rc = 0;
+	int i;
+
+	current = __atomic_load_n(&hp->online, __ATOMIC_RELAXED);
+	parked &= hp->cpus;
+	online = (current & ~parked) | (hp->cpus & ~parked);
+
+	for (i = 0; i < hp->nclusters; ++i) {
+		mask = hp->clusters[i];
+		if ((current & mask) == 0 || (online & mask) != 0)
+			continue;
+		/* keep the lowest online cpu of the cluster */
+		cpu = __builtin_ctzl(current & mask);
+		online |= 1UL << cpu;
+		LOGV("not parking cpu%u, last online in its cluster\n", cpu);
+	}
+
+	for (cpu = 0; cpu < HOTPLUG_MAX_CPUS; ++cpu) {
+		mask = 1UL << cpu;
+		if ((hp->cpus & mask) && (online & mask) &&
+				!(current & mask))
+			rc |= hotplug_set_cpu(hp, cpu, 1);
+	}
+	for (cpu = HOTPLUG_MAX_CPUS; cpu-- > 0; ) {
+		mask = 1UL << cpu;
+		if ((hp->cpus & mask) && !(online & mask) &&
+				(current & mask))
+			rc |= hotplug_set_cpu(hp, cpu, 0);
+	}
+
+	return rc;
+}
+
+unsigned long hotplug_parked(struct hotplug *hp)
+{
+	return hp->cpus & ~__atomic_load_n(&hp->online, __ATOMIC_RELAXED);
+}
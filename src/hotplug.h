@@ -0,0 +1,12 @@
+#ifndef _HOTPLUG_H_
+#define _HOTPLUG_H_
+
+struct hotplug;
+
+struct hotplug *hotplug_open(unsigned long cpus);
+void hotplug_close(struct hotplug *hp);
+
+int hotplug_park(struct hotplug *hp, unsigned long parked);
+unsigned long hotplug_parked(struct hotplug *hp);
+
+#endif
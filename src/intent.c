@@ -0,0 +1,277 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+#include "log.h"
+#include "util.h"
+#include "watch.h"
+#include "intent.h"
+
+#define INTENT_QUEUE_SIZE 8
+#define INTENT_CLASSPATH "CLASSPATH=/system/framework/am.jar"
+
+extern char **environ;
+
+/*
+ * Intents are broadcast by running am through app_process, which takes
+ * hundreds of milliseconds to start.  Instead of waiting for it, the child
+ * is spawned and reaped when SIGCHLD shows up on a signalfd polled by the
+ * main loop.  One broadcast runs at a time; the others wait in a bounded
+ * queue where a newer intent replaces a pending one with the same action.
+ * The queue is locked, as intents may be sent from the actuator thread.
+ */
+struct intent_entry {
+	char action[256];
+	char notice[256];
+	int has_notice;
+};
+
+struct intent_manager {
+	pthread_mutex_t lock;
+	int fd;
+	struct watch_ticket *ticket;
+	char **envp;
+
+	struct intent_entry queue[INTENT_QUEUE_SIZE];
+	int head;
+	int count;
+
+	pid_t pid;
+	char running[256];
+	unsigned long long start_us;
+
+	unsigned int sent;
+	unsigned int coalesced;
+	unsigned int dropped;
+	unsigned long long total_us;
+	unsigned long long max_us;
+};
+
+static struct intent_manager g_intent_manager = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = -1,
+	.pid = -1,
+};
+
+static void intent_spawn_next(struct intent_manager *im);
+
+static int intent_spawn(struct intent_manager *im, struct intent_entry *e)
+{
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	char *argv[9];
+	int argc = 0;
+	int rc;
+
+	argv[argc++] = "app_process";
+	argv[argc++] = "/system/bin/";
+	argv[argc++] = "com.android.commands.am.Am";
+	argv[argc++] = "broadcast";
+	argv[argc++] = "-a";
+	argv[argc++] = e->action;
+	if (e->has_notice) {
+		argv[argc++] = "-e";
+		argv[argc++] = "notice";
+		argv[argc++] = e->notice;
+	}
+	argv[argc] = NULL;
+
+	/* the child must not inherit the blocked SIGCHLD */
+	sigemptyset(&mask);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	rc = posix_spawnp(&im->pid, "app_process", NULL, &attr, argv,
+			im->envp ? im->envp : environ);
+	posix_spawnattr_destroy(&attr);
+	if (rc) {
+		LOGE("failed to launch am with intent \"%s\"\n", e->action);
+		im->pid = -1;
+		return -1;
+	}
+
+	strcpy(im->running, e->action);
+	im->start_us = util_time_us();
+	return 0;
+}
+
+static void intent_reaped(struct intent_manager *im, int status)
+{
+	unsigned long long latency;
+
+	latency = util_time_us() - im->start_us;
+	im->sent++;
+	im->total_us += latency;
+	if (latency > im->max_us)
+		im->max_us = latency;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		LOGW("am with intent \"%s\" failed, status %d\n",
+				im->running, status);
+	LOGV("intent \"%s\" delivered in %llu ms (avg %llu ms, max %llu ms)\n",
+			im->running, latency / 1000,
+			im->total_us / im->sent / 1000, im->max_us / 1000);
+
+	im->pid = -1;
+}
+
+static void intent_spawn_next(struct intent_manager *im)
+{
+	struct intent_entry *e;
+	int status;
+
+	while (im->pid == -1 && im->count > 0) {
+		e = &im->queue[im->head];
+		im->head = (im->head + 1) % INTENT_QUEUE_SIZE;
+		im->count--;
+
+		if (intent_spawn(im, e))
+			continue;
+
+		/* nothing reaps the child without the main loop */
+		if (im->ticket == NULL) {
+			waitpid(im->pid, &status, 0);
+			intent_reaped(im, status);
+		}
+	}
+}
+
+static void intent_cb(void *data, struct watch_ticket *ticket)
+{
+	struct intent_manager *im = data;
+	struct signalfd_siginfo si;
+	int status;
+
+	watch_ticket_clear(ticket);
+
+	while (read(im->fd, &si, sizeof(si)) == sizeof(si))
+		;
+
+	pthread_mutex_lock(&im->lock);
+	if (im->pid != -1 && waitpid(im->pid, &status, WNOHANG) == im->pid)
+		intent_reaped(im, status);
+
+	intent_spawn_next(im);
+	pthread_mutex_unlock(&im->lock);
+}
+
+int intent_open(void)
+{
+	struct intent_manager *im = &g_intent_manager;
+	sigset_t mask;
+	int count;
+	int i, j;
+
+	if (im->fd != -1)
+		return 0;
+
+	for (count = 0; environ[count] != NULL; ++count)
+		;
+	im->envp = calloc(count + 2, sizeof(im->envp[0]));
+	if (im->envp == NULL)
+		return -1;
+	for (i = j = 0; i < count; ++i) {
+		if (strncmp(environ[i], "CLASSPATH=", 10))
+			im->envp[j++] = environ[i];
+	}
+	im->envp[j] = INTENT_CLASSPATH;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL)) {
+		LOGW("unable to block SIGCHLD\n");
+		return -1;
+	}
+	im->fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (im->fd == -1) {
+		LOGW("unable to open signalfd\n");
+		sigprocmask(SIG_UNBLOCK, &mask, NULL);
+		return -1;
+	}
+
+	return 0;
+}
+
+int intent_send(const char *action, const char *notice)
+{
+	struct intent_manager *im = &g_intent_manager;
+	struct intent_entry *e;
+	int rc = 0;
+	int i;
+
+	pthread_mutex_lock(&im->lock);
+	for (i = 0; i < im->count; ++i) {
+		e = &im->queue[(im->head + i) % INTENT_QUEUE_SIZE];
+		if (!strcmp(e->action, action)) {
+			im->coalesced++;
+			goto fill;
+		}
+	}
+
+	if (im->count == INTENT_QUEUE_SIZE) {
+		im->dropped++;
+		LOGW("intent queue full, dropping \"%s\"\n", action);
+		rc = -1;
+		goto out;
+	}
+	e = &im->queue[(im->head + im->count) % INTENT_QUEUE_SIZE];
+	im->count++;
+	strncpy(e->action, action, sizeof(e->action));
+	e->action[sizeof(e->action) - 1] = 0;
+
+fill:
+	e->has_notice = notice != NULL;
+	if (notice != NULL) {
+		strncpy(e->notice, notice, sizeof(e->notice));
+		e->notice[sizeof(e->notice) - 1] = 0;
+	}
+
+	intent_spawn_next(im);
+out:
+	pthread_mutex_unlock(&im->lock);
+	return rc;
+}
+
+void intent_manager_enable(void)
+{
+	struct intent_manager *im = &g_intent_manager;
+
+	struct watch_ticket *ticket;
+
+	if (im->fd == -1 || im->ticket != NULL)
+		return;
+
+	ticket = watch_manager_add_input(im->fd);
+	if (ticket == NULL)
+		return;
+	watch_ticket_callback(ticket, intent_cb, im);
+
+	pthread_mutex_lock(&im->lock);
+	im->ticket = ticket;
+	pthread_mutex_unlock(&im->lock);
+}
+
+void intent_manager_disable(void)
+{
+	struct intent_manager *im = &g_intent_manager;
+
+	pthread_mutex_lock(&im->lock);
+	if (im->ticket != NULL) {
+		watch_ticket_delete(im->ticket);
+		im->ticket = NULL;
+	}
+	pthread_mutex_unlock(&im->lock);
+
+	if (im->sent)
+		LOGI("%u intents sent, %u coalesced, %u dropped,"
+				" avg %llu ms, max %llu ms\n",
+				im->sent, im->coalesced, im->dropped,
+				im->total_us / im->sent / 1000,
+				im->max_us / 1000);
+}
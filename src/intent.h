@@ -0,0 +1,10 @@
+#ifndef _INTENT_H_
+#define _INTENT_H_
+
+int intent_open(void);
+int intent_send(const char *action, const char *notice);
+
+void intent_manager_enable(void);
+void intent_manager_disable(void);
+
+#endif
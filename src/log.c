@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "log.h"
+#include "util.h"
+
+#define LOG_RING_SIZE 128
+#define LOG_LINE_MAX 256
+
+/* messages a call site may log per interval before it is muted */
+#define LOG_SITE_BURST 10
+#define LOG_SITE_INTERVAL_MS 1000
+
+/*
+ * Once the logger is started, messages are formatted into a preallocated
+ * ring and written out by a SCHED_IDLE thread, so logging from the main
+ * loop costs a vsnprintf rather than a write to stderr or logd.
+ *
+ * Any thread may log, so slots are claimed with a compare and swap on the
+ * head and handed over through a per-slot sequence number: a slot is free
+ * for position pos when its sequence is pos, and filled when it is
+ * pos + 1.  A message that finds the ring full is dropped and counted.
+ */
+struct log_entry {
+	unsigned int seq;
+	int prio;
+	char msg[LOG_LINE_MAX];
+};
+
+static struct log_entry g_log_ring[LOG_RING_SIZE];
+static unsigned int g_log_head;
+static unsigned int g_log_tail;
+static unsigned int g_log_dropped;
+static int g_log_running;
+static sem_t g_log_sem;
+static pthread_t g_log_thread;
+
+static void log_output(int prio, const char *msg)
+{
+#ifdef ANDROID
+	__android_log_write(prio, LOG_TAG, msg);
+#else
+	fprintf(stderr, "[%c] "LOG_TAG": %s", prio, msg);
+#endif
+}
+
+static void log_vprintf(int prio, const char *fmt, va_list ap)
+{
+	struct log_entry *e;
+	char buf[LOG_LINE_MAX];
+	unsigned int pos;
+	int diff;
+
+	if (!__atomic_load_n(&g_log_running, __ATOMIC_ACQUIRE)) {
+		vsnprintf(buf, sizeof(buf), fmt, ap);
+		log_output(prio, buf);
+		return;
+	}
+
+	pos = __atomic_load_n(&g_log_head, __ATOMIC_RELAXED);
+	for (;;) {
+		e = &g_log_ring[pos % LOG_RING_SIZE];
+		diff = (int)(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&g_log_head, &pos,
+					pos + 1, 1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_add_fetch(&g_log_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&g_log_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	e->prio = prio;
+	vsnprintf(e->msg, sizeof(e->msg), fmt, ap);
+	__atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&g_log_sem);
+}
+
+static void log_printf(int prio, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_vprintf(prio, fmt, ap);
+	va_end(ap);
+}
+
+/*
+ * Logs a message from a call site, unless it already logged
+ * LOG_SITE_BURST messages in the current interval.  The number of muted
+ * messages is reported with the first message of a later interval.
+ *
+ * Messages logged before the ring runs, like startup diagnostics, are
+ * never muted.  Sites such as those in resource.c are reached from both
+ * the main loop and the actuator thread, so the site state is only
+ * touched atomically; the thread that moves the window on reports and
+ * resets it.  The window is kept in the low 32 bits of the time, which
+ * is fine for intervals well below 49 days.
+ */
+void log_write(struct log_site *site, int prio, const char *fmt, ...)
+{
+	unsigned int now = util_time_ms();
+	unsigned int suppressed = 0;
+	unsigned int window;
+	va_list ap;
+
+	if (!__atomic_load_n(&g_log_running, __ATOMIC_ACQUIRE))
+		goto out;
+
+	window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+	if (now - window >= LOG_SITE_INTERVAL_MS &&
+			__atomic_compare_exchange_n(&site->window, &window,
+					now, 0, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED)) {
+		__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+		suppressed = __atomic_exchange_n(&site->suppressed, 0,
+				__ATOMIC_RELAXED);
+	}
+
+	if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) >=
+			LOG_SITE_BURST) {
+		__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (suppressed)
+		log_printf(prio, "%s:%d: %u messages suppressed\n",
+				site->file, site->line, suppressed);
+
+out:
+	va_start(ap, fmt);
+	log_vprintf(prio, fmt, ap);
+	va_end(ap);
+}
+
+static void log_drain(void)
+{
+	struct log_entry *e;
+	unsigned int dropped;
+	char buf[64];
+
+	for (;;) {
+		e = &g_log_ring[g_log_tail % LOG_RING_SIZE];
+		if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != g_log_tail + 1)
+			break;
+		log_output(e->prio, e->msg);
+		__atomic_store_n(&e->seq, g_log_tail + LOG_RING_SIZE,
+				__ATOMIC_RELEASE);
+		g_log_tail++;
+	}
+
+	dropped = __atomic_exchange_n(&g_log_dropped, 0, __ATOMIC_RELAXED);
+	if (dropped) {
+		snprintf(buf, sizeof(buf), "%u messages dropped\n", dropped);
+		log_output(LOG_PRIO_WARN, buf);
+	}
+}
+
+static void *log_thread(void *arg __attribute__ ((__unused__)))
+{
+	struct sched_param param = { 0 };
+
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+	for (;;) {
+		while (sem_wait(&g_log_sem) && errno == EINTR)
+			;
+		log_drain();
+		if (!__atomic_load_n(&g_log_running, __ATOMIC_ACQUIRE))
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Starts the writer thread.  Until then, and if it fails, messages are
+ * written synchronously.
+ */
+int log_start(void)
+{
+	unsigned int i;
+
+	if (g_log_running)
+		return 0;
+
+	for (i = 0; i < LOG_RING_SIZE; ++i)
+		g_log_ring[i].seq = i;
+	g_log_head = 0;
+	g_log_tail = 0;
+
+	if (sem_init(&g_log_sem, 0, 0))
+		return -1;
+
+	__atomic_store_n(&g_log_running, 1, __ATOMIC_RELEASE);
+	if (pthread_create(&g_log_thread, NULL, log_thread, NULL)) {
+		__atomic_store_n(&g_log_running, 0, __ATOMIC_RELEASE);
+		sem_destroy(&g_log_sem);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Writes out everything still queued and returns to synchronous logging.
+ */
+void log_stop(void)
+{
+	if (!g_log_running)
+		return;
+
+	__atomic_store_n(&g_log_running, 0, __ATOMIC_RELEASE);
+	sem_post(&g_log_sem);
+	pthread_join(g_log_thread, NULL);
+	log_drain();
+	sem_destroy(&g_log_sem);
+}
@@ -5,22 +5,53 @@
 
 #include <cutils/log.h>
 #include <cutils/klog.h>
+#define LOG_PRIO_INFO ANDROID_LOG_INFO
+#define LOG_PRIO_WARN ANDROID_LOG_WARN
+#define LOG_PRIO_ERROR ANDROID_LOG_ERROR
 #define LOGV ALOGV
-#define LOGI ALOGI
-#define LOGW ALOGW
-#define LOGE ALOGE
+#define LOGI(x, ...) LOG_ASYNC(LOG_PRIO_INFO, x, ##__VA_ARGS__)
+#define LOGW(x, ...) LOG_ASYNC(LOG_PRIO_WARN, x, ##__VA_ARGS__)
+#define LOGE(x, ...) LOG_ASYNC(LOG_PRIO_ERROR, x, ##__VA_ARGS__)
 #define KLOGE(x, ...) KLOG_ERROR(LOG_TAG, x, ##__VA_ARGS__)
 
 #elif defined(__linux__)
 
 #include <stdio.h>
-#define LOGV(x, ...) fprintf(stderr, "[V] "LOG_TAG": " x, ##__VA_ARGS__)
-#define LOGI(x, ...) fprintf(stderr, "[I] "LOG_TAG": " x, ##__VA_ARGS__)
-#define LOGW(x, ...) fprintf(stderr, "[W] "LOG_TAG": " x, ##__VA_ARGS__)
-#define LOGE(x, ...) fprintf(stderr, "[E] "LOG_TAG": " x, ##__VA_ARGS__)
+#define LOG_PRIO_VERBOSE 'V'
+#define LOG_PRIO_INFO 'I'
+#define LOG_PRIO_WARN 'W'
+#define LOG_PRIO_ERROR 'E'
+#define LOGV(x, ...) LOG_ASYNC(LOG_PRIO_VERBOSE, x, ##__VA_ARGS__)
+#define LOGI(x, ...) LOG_ASYNC(LOG_PRIO_INFO, x, ##__VA_ARGS__)
+#define LOGW(x, ...) LOG_ASYNC(LOG_PRIO_WARN, x, ##__VA_ARGS__)
+#define LOGE(x, ...) LOG_ASYNC(LOG_PRIO_ERROR, x, ##__VA_ARGS__)
 #define KLOGE(x, ...) fprintf(stderr, "[E] "LOG_TAG": " x, ##__VA_ARGS__)
 
 #endif
 #define LOG LOGI
 
+/*
+ * Each call site gets its own rate limit state, see log_write().
+ */
+struct log_site {
+	const char *file;
+	int line;
+	unsigned int window;
+	unsigned int count;
+	unsigned int suppressed;
+};
+
+#define LOG_ASYNC(prio, x, ...) do { \
+	static struct log_site __log_site = { \
+		.file = __FILE__, \
+		.line = __LINE__, \
+	}; \
+	log_write(&__log_site, prio, x, ##__VA_ARGS__); \
+} while (0)
+
+void log_write(struct log_site *site, int prio, const char *fmt, ...)
+		__attribute__ ((format (printf, 3, 4)));
+int log_start(void);
+void log_stop(void);
+
 #endif
@@ -1,12 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <getopt.h>
 
 #include "configuration.h"
+#include "curve.h"
+#include "pid.h"
+#include "model.h"
+#include "actuator.h"
+#include "slowread.h"
+#include "realtime.h"
+#include "recorder.h"
+#include "state.h"
 #include "control.h"
 #include "threshold.h"
 #include "mitigation.h"
 #include "resource.h"
+#include "thermal_zone.h"
 #include "log.h"
 
 #include "dom.h"
@@ -61,12 +72,296 @@ static int parse_multi_X(const struct dom_obj *obj, const char *name,
 	return 0;
 }
 
+struct class_match {
+	const char *name;
+	const char *type;
+	struct resource *(* open_fn)(const char *name, const char *dir);
+	const char *cnames[256];
+	char names[256][256];
+	int count;
+	int dropped;
+};
+
+static void parse_class_match_one(void *data, const char *dir,
+		const char *type)
+{
+	struct class_match *m = (struct class_match *)data;
+	struct resource *res;
+	char *cname;
+	int i;
+
+	if (m->count == 256) {
+		m->dropped++;
+		return;
+	}
+
+	cname = m->names[m->count];
+	snprintf(cname, sizeof(m->names[0]), "%s-%s", m->name, type);
+	for (i = 1; resource_manager_find(cname) != NULL; ++i)
+		snprintf(cname, sizeof(m->names[0]), "%s-%s-%d",
+				m->name, type, i);
+
+	res = (* m->open_fn)(cname, dir);
+	if (res == NULL) {
+		LOGW("failed to attach %s\n", dir);
+		return;
+	}
+	LOGV("attached resource \"%s\" [%s] from %s\n", cname, m->type, dir);
+	resource_manager_add(res);
+
+	m->cnames[m->count++] = cname;
+}
+
+static void parse_class_first(void *data, const char *dir,
+		const char *type __attribute__ ((__unused__)))
+{
+	char *first = (char *)data;
+
+	if (first[0] == 0)
+		snprintf(first, PATH_MAX, "%s", dir);
+}
+
+/*
+ * Resolve a resource in /sys/class/thermal by its type rather than by
+ * path.  A plain type selects the first device of that type, while a glob
+ * attaches every matching device as "<name>-<type>" and groups them in a
+ * union named "<name>".
+ */
+static struct resource *parse_class_match(const char *name, const char *type,
+		const char *kind, const char *pattern,
+		struct resource *(* open_fn)(const char *name, const char *dir))
+{
+	struct class_match *m;
+	struct resource *res;
+	char first[PATH_MAX];
+
+	if (strpbrk(pattern, "*?[") == NULL) {
+		first[0] = 0;
+		thermal_class_match(kind, pattern, parse_class_first, first);
+		if (first[0] == 0)
+			return NULL;
+		return (* open_fn)(name, first);
+	}
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL)
+		return NULL;
+	m->name = name;
+	m->type = type;
+	m->open_fn = open_fn;
+
+	thermal_class_match(kind, pattern, parse_class_match_one, m);
+	if (m->dropped)
+		LOGW("%s: \"%s\" matches more than %d devices, ignoring %d\n",
+				name, pattern, m->count, m->dropped);
+
+	res = NULL;
+	if (m->count > 0)
+		res = resource_union_open(name, m->count, m->cnames);
+	free(m);
+
+	return res;
+}
+
+static int parse_model_node(struct resource *res, const struct dom_obj *obj)
+{
+	const char *name;
+	const char *capacitance;
+	const char *temp;
+	const char *resource;
+
+	name = dom_obj_attribute_value(obj, "name");
+	if (name == NULL) {
+		LOGE("model node missing 'name' attribute\n");
+		return -1;
+	}
+	capacitance = dom_obj_attribute_value(obj, "capacitance");
+	temp = dom_obj_attribute_value(obj, "temp");
+	resource = dom_obj_attribute_value(obj, "resource");
+
+	if (capacitance != NULL)
+		return model_add_mass(res, name, strtol(capacitance, 0, 0),
+				temp ? strtol(temp, 0, 0) : MODEL_TEMP_UNSET,
+				dom_obj_attribute_value(obj, "power"));
+	if (resource != NULL)
+		return model_add_driven(res, name, resource);
+	if (temp != NULL)
+		return model_add_fixed(res, name, strtol(temp, 0, 0));
+
+	LOGE("model node %s needs 'capacitance', 'resource' or 'temp'\n",
+			name);
+	return -1;
+}
+
+static int parse_model_link(struct resource *res, const struct dom_obj *obj)
+{
+	const char *from;
+	const char *to;
+	const char *resistance;
+
+	from = dom_obj_attribute_value(obj, "from");
+	to = dom_obj_attribute_value(obj, "to");
+	resistance = dom_obj_attribute_value(obj, "resistance");
+	if (from == NULL || to == NULL || resistance == NULL) {
+		LOGE("model link missing 'from', 'to' or 'resistance'"
+				" attribute\n");
+		return -1;
+	}
+
+	return model_add_link(res, from, to, strtol(resistance, 0, 0));
+}
+
+static struct resource *parse_model(const char *name,
+		const struct dom_obj *obj)
+{
+	const struct list_node *node;
+	const struct dom_obj *child;
+	struct resource *res;
+	const char *interval;
+	const char *output;
+	int rc;
+
+	interval = dom_obj_attribute_value(obj, "interval");
+	res = model_create(name, interval ? strtoul(interval, 0, 0) : 1000);
+	if (res == NULL)
+		return NULL;
+
+	for_list_node(&obj->children, node) {
+		child = list_entry(node, const struct dom_obj, list_node);
+		if (!strcmp("node", child->name))
+			rc = parse_model_node(res, child);
+		else if (!strcmp("link", child->name))
+			rc = parse_model_link(res, child);
+		else
+			rc = -1;
+		if (rc)
+			goto fail;
+	}
+
+	output = dom_obj_attribute_value(obj, "output");
+	if (output != NULL && model_set_output(res, output))
+		goto fail;
+
+	return res;
+
+fail:
+	resource_close(res);
+	return NULL;
+}
+
+static struct resource *parse_filter(const char *name,
+		const struct dom_obj *obj)
+{
+	enum resource_filter_type type;
+	const char *alias;
+	const char *attr;
+	const char *interval;
+	int param1, param2;
+
+	alias = dom_obj_attribute_value(obj, "resource");
+	if (alias == NULL)
+		return NULL;
+
+	param1 = param2 = 0;
+	attr = dom_obj_attribute_value(obj, "filter");
+	if (attr == NULL || !strcmp(attr, "ewma")) {
+		type = RESOURCE_FILTER_EWMA;
+		attr = dom_obj_attribute_value(obj, "alpha");
+		param1 = attr ? strtod(attr, 0) * RESOURCE_FILTER_ALPHA_ONE :
+				RESOURCE_FILTER_ALPHA_ONE / 4;
+	} else if (!strcmp(attr, "median")) {
+		type = RESOURCE_FILTER_MEDIAN;
+		attr = dom_obj_attribute_value(obj, "size");
+		param1 = attr ? strtol(attr, 0, 0) : 5;
+	} else if (!strcmp(attr, "kalman")) {
+		type = RESOURCE_FILTER_KALMAN;
+		attr = dom_obj_attribute_value(obj, "q");
+		param1 = attr ? strtol(attr, 0, 0) : 10000;
+		attr = dom_obj_attribute_value(obj, "r");
+		param2 = attr ? strtol(attr, 0, 0) : 1000000;
+	} else {
+		LOGE("%s: unknown filter \"%s\"\n", name, attr);
+		return NULL;
+	}
+
+	interval = dom_obj_attribute_value(obj, "interval");
+	return resource_filter_open(name, alias, type, param1, param2,
+			interval ? strtoul(interval, 0, 0) : 1000);
+}
+
+static struct resource *parse_fusion(const char *name,
+		const struct dom_obj *obj)
+{
+	enum resource_fusion_op op;
+	const struct list_node *node;
+	const struct dom_obj *child;
+	const char *cnames[256];
+	int weights[256];
+	const char *attr;
+	unsigned int interval;
+	double weight;
+	int count;
+
+	attr = dom_obj_attribute_value(obj, "op");
+	if (attr == NULL || !strcmp(attr, "max"))
+		op = RESOURCE_FUSION_MAX;
+	else if (!strcmp(attr, "min"))
+		op = RESOURCE_FUSION_MIN;
+	else if (!strcmp(attr, "avg"))
+		op = RESOURCE_FUSION_AVG;
+	else if (!strcmp(attr, "wsum"))
+		op = RESOURCE_FUSION_WSUM;
+	else {
+		LOGE("%s: unknown fusion op \"%s\"\n", name, attr);
+		return NULL;
+	}
+
+	count = 0;
+	for_list_node(&obj->children, node) {
+		child = list_entry(node, const struct dom_obj, list_node);
+		if (strcmp("resource", child->name)) {
+			LOGE("%s: unexpected <%s> in fusion\n", name,
+					child->name);
+			return NULL;
+		}
+		if (count == 256) {
+			LOGE("%s: too many fusion members\n", name);
+			return NULL;
+		}
+		cnames[count] = dom_obj_attribute_value(child, "name");
+		if (cnames[count] == NULL) {
+			LOGE("%s: fusion member missing 'name' attribute\n",
+					name);
+			return NULL;
+		}
+		attr = dom_obj_attribute_value(child, "weight");
+		weight = attr ? strtod(attr, 0) : 1;
+		weight *= RESOURCE_FUSION_WEIGHT_ONE;
+		weights[count] = weight < 0 ? weight - 0.5 : weight + 0.5;
+		count++;
+	}
+
+	/* weighted sums cannot follow member edges and are polled */
+	attr = dom_obj_attribute_value(obj, "interval");
+	if (attr != NULL)
+		interval = strtoul(attr, 0, 0);
+	else if (op == RESOURCE_FUSION_AVG || op == RESOURCE_FUSION_WSUM)
+		interval = 1000;
+	else
+		interval = 0;
+
+	attr = dom_obj_attribute_value(obj, "offset");
+	return resource_fusion_open(name, op, count, cnames, weights,
+			attr ? strtol(attr, 0, 0) : 0, interval);
+}
+
 static int parse_one_resource(void *data __attribute__ ((__unused__)),
 		const struct dom_obj *obj)
 {
 	struct resource *res;
 	const char *type;
 	const char *name;
+	const char *attr;
 
 	type = dom_obj_attribute_value(obj, "type");
 	if (type == NULL) {
@@ -81,9 +376,15 @@ static int parse_one_resource(void *data __attribute__ ((__unused__)),
 
 	res = NULL;
 	if (!strcmp(type, "tz")) {
-		if (obj->content == NULL)
+		const char *match;
+		match = dom_obj_attribute_value(obj, "type-match");
+		if (match != NULL)
+			res = parse_class_match(name, type, "thermal_zone",
+					match, resource_tz_open);
+		else if (obj->content == NULL)
 			return -1;
-		res = resource_tz_open(name, obj->content);
+		else
+			res = resource_tz_open(name, obj->content);
 	} else if (!strcmp(type, "alias")) {
 		const char *alias;
 		alias = dom_obj_attribute_value(obj, "resource");
@@ -150,6 +451,73 @@ static int parse_one_resource(void *data __attribute__ ((__unused__)),
 		if (obj->content == NULL)
 			return -1;
 		res = resource_cpufreq_open(name, obj->content);
+	} else if (!strcmp(type, "devfreq")) {
+		if (obj->content == NULL)
+			return -1;
+		res = resource_devfreq_open(name, obj->content);
+	} else if (!strcmp(type, "powercap")) {
+		const char *constraint;
+		const char *window;
+		const char *interval;
+
+		if (obj->content == NULL)
+			return -1;
+		constraint = dom_obj_attribute_value(obj, "constraint");
+		window = dom_obj_attribute_value(obj, "window");
+		interval = dom_obj_attribute_value(obj, "interval");
+		res = resource_powercap_open(name, obj->content,
+				constraint ? strtol(constraint, 0, 0) : 0,
+				window ? strtol(window, 0, 0) : 2,
+				interval ? strtoul(interval, 0, 0) : 1000);
+	} else if (!strcmp(type, "cgroup")) {
+		const char *file;
+		const char *period;
+
+		if (obj->content == NULL)
+			return -1;
+		file = dom_obj_attribute_value(obj, "file");
+		if (file == NULL) {
+			LOGE("cgroup resource missing 'file' attribute\n");
+			return -1;
+		}
+		period = dom_obj_attribute_value(obj, "period");
+		res = resource_cgroup_open(name, obj->content, file,
+				period ? strtoul(period, 0, 0) : 100000);
+	} else if (!strcmp(type, "hotplug")) {
+		if (obj->content == NULL)
+			return -1;
+		res = resource_hotplug_open(name, obj->content);
+	} else if (!strcmp(type, "predict")) {
+		const char *alias;
+		const char *horizon;
+		const char *samples;
+		const char *interval;
+
+		alias = dom_obj_attribute_value(obj, "resource");
+		horizon = dom_obj_attribute_value(obj, "horizon");
+		if (alias == NULL || horizon == NULL)
+			return -1;
+		samples = dom_obj_attribute_value(obj, "samples");
+		interval = dom_obj_attribute_value(obj, "interval");
+		res = resource_predict_open(name, alias, strtol(horizon, 0, 0),
+				samples ? strtol(samples, 0, 0) : 8,
+				interval ? strtoul(interval, 0, 0) : 1000);
+	} else if (!strcmp(type, "filter")) {
+		res = parse_filter(name, obj);
+	} else if (!strcmp(type, "fusion")) {
+		res = parse_fusion(name, obj);
+	} else if (!strcmp(type, "model")) {
+		res = parse_model(name, obj);
+	} else if (!strcmp(type, "cooling-device")) {
+		const char *match;
+		match = dom_obj_attribute_value(obj, "type-match");
+		if (match != NULL)
+			res = parse_class_match(name, type, "cooling_device",
+					match, resource_cooling_open);
+		else if (obj->content == NULL)
+			return -1;
+		else
+			res = resource_cooling_open(name, obj->content);
 	}
 
 	if (res == NULL) {
@@ -159,6 +527,19 @@ static int parse_one_resource(void *data __attribute__ ((__unused__)),
 	}
 	LOGV("attached resource \"%s\" [%s]\n", name, type);
 
+	attr = dom_obj_attribute_value(obj, "slow");
+	if (attr != NULL && !strcmp(attr, "true")) {
+		struct resource *slow;
+
+		attr = dom_obj_attribute_value(obj, "deadline");
+		slow = slowread_wrap(res,
+				attr ? strtoul(attr, 0, 0) : 50);
+		if (slow == NULL)
+			LOGW("%s: unable to read in the background\n", name);
+		else
+			res = slow;
+	}
+
 	resource_manager_add(res);
 
 	return 0;
@@ -172,7 +553,10 @@ static int parse_resources(const struct dom_obj *obj)
 static int parse_one_mitigation_resource(void *data, const struct dom_obj *obj)
 {
 	struct mitigation *mig;
+	const char *index;
 	const char *name;
+	char *end;
+	int value;
 
 	name = dom_obj_attribute_value(obj, "resource");
 	if (name == NULL) {
@@ -181,6 +565,23 @@ static int parse_one_mitigation_resource(void *data, const struct dom_obj *obj)
 	}
 
 	mig = (struct mitigation *)data;
+
+	index = dom_obj_attribute_value(obj, "opp-index");
+	if (index != NULL) {
+		mitigation_add_resource_unit(mig, name, RESOURCE_UNIT_INDEX,
+				strtol(index, 0, 0));
+		return 0;
+	}
+
+	if (obj->content != NULL) {
+		value = strtol(obj->content, &end, 0);
+		if (end != obj->content && !strcmp(end, "%")) {
+			mitigation_add_resource_unit(mig, name,
+					RESOURCE_UNIT_PERCENT, value);
+			return 0;
+		}
+	}
+
 	mitigation_add_resource(mig, name, obj->content ? obj->content : "");
 
 	return 0;
@@ -225,6 +626,9 @@ static int parse_control(const struct dom_obj *obj)
 {
 	struct control *ctrl;
 	const char *name;
+	const char *dwell;
+	const char *rate;
+	const char *bound;
 	int rc;
 
 	name = dom_obj_attribute_value(obj, "name");
@@ -237,6 +641,13 @@ static int parse_control(const struct dom_obj *obj)
 	if (ctrl == NULL)
 		return -1;
 
+	dwell = dom_obj_attribute_value(obj, "min-dwell-ms");
+	rate = dom_obj_attribute_value(obj, "max-transitions-per-sec");
+	bound = dom_obj_attribute_value(obj, "max-escalation-delay-ms");
+	control_set_policy(ctrl, dwell ? strtoul(dwell, 0, 0) : 0,
+			rate ? strtoul(rate, 0, 0) : 0,
+			bound ? strtoul(bound, 0, 0) : 500);
+
 	rc = parse_multi_X(obj, "mitigation", parse_one_mitigation, ctrl);
 	if (rc) {
 		LOGE("failed to parse control mitigations\n");
@@ -338,6 +749,125 @@ static int parse_config(const struct dom_obj *obj)
 	return 0;
 }
 
+static int parse_one_curve_point(void *data, const struct dom_obj *obj)
+{
+	const char *input;
+	const char *output;
+
+	input = dom_obj_attribute_value(obj, "temp");
+	if (input == NULL)
+		input = dom_obj_attribute_value(obj, "input");
+	output = dom_obj_attribute_value(obj, "value");
+	if (input == NULL || output == NULL) {
+		LOGE("point missing 'temp' or 'value' attribute\n");
+		return -1;
+	}
+
+	return curve_add_point((struct configuration *)data,
+			strtol(input, 0, 0), strtol(output, 0, 0));
+}
+
+static int parse_curve(const struct dom_obj *obj)
+{
+	struct configuration *cfg;
+	const char *sensor;
+	const char *resource;
+	const char *deadband;
+	const char *interval;
+	int rc;
+
+	sensor = dom_obj_attribute_value(obj, "sensor");
+	resource = dom_obj_attribute_value(obj, "resource");
+	if (sensor == NULL || resource == NULL) {
+		LOGE("curve section missing 'sensor' or 'resource' attribute\n");
+		return -1;
+	}
+	deadband = dom_obj_attribute_value(obj, "deadband");
+	interval = dom_obj_attribute_value(obj, "interval");
+
+	cfg = curve_create(sensor, resource,
+			deadband ? strtol(deadband, 0, 0) : 0,
+			interval ? strtoul(interval, 0, 0) : 1000);
+	if (cfg == NULL) {
+		LOGE("failed to create curve with sensor \"%s\""
+				" and resource \"%s\"\n", sensor, resource);
+		return -1;
+	}
+
+	rc = parse_multi_X(obj, "point", parse_one_curve_point, cfg);
+	if (rc) {
+		LOGE("failed to parse curve points\n");
+		configuration_destroy(cfg);
+		return rc;
+	}
+
+	configuration_manager_add(cfg);
+
+	return 0;
+}
+
+static int parse_pid(const struct dom_obj *obj)
+{
+	struct configuration *cfg;
+	struct pid_gains gains;
+	const char *sensor;
+	const char *setpoint;
+	const char *control;
+	const char *resource;
+	const char *interval;
+	const char *attr;
+	unsigned int ival;
+
+	sensor = dom_obj_attribute_value(obj, "sensor");
+	setpoint = dom_obj_attribute_value(obj, "setpoint");
+	if (sensor == NULL || setpoint == NULL) {
+		LOGE("pid section missing 'sensor' or 'setpoint' attribute\n");
+		return -1;
+	}
+	control = dom_obj_attribute_value(obj, "control");
+	resource = dom_obj_attribute_value(obj, "resource");
+	if ((control == NULL) == (resource == NULL)) {
+		LOGE("pid section needs either a 'control' or a"
+				" 'resource' attribute\n");
+		return -1;
+	}
+
+	attr = dom_obj_attribute_value(obj, "kp");
+	gains.kp = attr ? strtod(attr, 0) : 0;
+	attr = dom_obj_attribute_value(obj, "ki");
+	gains.ki = attr ? strtod(attr, 0) : 0;
+	attr = dom_obj_attribute_value(obj, "kd");
+	gains.kd = attr ? strtod(attr, 0) : 0;
+	interval = dom_obj_attribute_value(obj, "interval");
+	ival = interval ? strtoul(interval, 0, 0) : 1000;
+
+	if (control != NULL) {
+		cfg = pid_create_control(sensor, control,
+				strtol(setpoint, 0, 0), &gains, ival);
+	} else {
+		const char *min;
+		const char *max;
+
+		min = dom_obj_attribute_value(obj, "min");
+		max = dom_obj_attribute_value(obj, "max");
+		if (min == NULL || max == NULL) {
+			LOGE("pid section missing 'min' or 'max' attribute\n");
+			return -1;
+		}
+		cfg = pid_create_resource(sensor, resource,
+				strtol(setpoint, 0, 0), &gains,
+				strtol(min, 0, 0), strtol(max, 0, 0), ival);
+	}
+	if (cfg == NULL) {
+		LOGE("failed to create pid with sensor \"%s\"\n", sensor);
+		return -1;
+	}
+
+	configuration_manager_add(cfg);
+
+	return 0;
+}
+
 static int parse(const char *file)
 {
 	struct dom *dom;
@@ -351,6 +881,7 @@ static int parse(const char *file)
 		return -1;
 	}
 	resource_manager_prepare();
+	thermal_class_release();
 
 	if (parse_only_X(dom->root, "control", parse_control)) {
 		LOGE("failed to parse control sections\n");
@@ -360,23 +891,119 @@ static int parse(const char *file)
 		LOGE("failed to parse configuration sections\n");
 		return -1;
 	}
+	if (parse_only_X(dom->root, "curve", parse_curve)) {
+		LOGE("failed to parse curve sections\n");
+		return -1;
+	}
+	if (parse_only_X(dom->root, "pid", parse_pid)) {
+		LOGE("failed to parse pid sections\n");
+		return -1;
+	}
 
 	dom_destroy(dom);
 
 	return 0;
 }
 
+static const struct option options[] = {
+	{ "actuator-thread", no_argument, NULL, 'a' },
+	{ "io-uring", no_argument, NULL, 'u' },
+	{ "realtime", optional_argument, NULL, 'r' },
+	{ "flight-recorder", optional_argument, NULL, 'f' },
+	{ "state-page", optional_argument, NULL, 's' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(const char *name)
+{
+	LOGE("Usage: %s [-a|--actuator-thread] [-u|--io-uring] "
+			"[-r|--realtime[=cpu]] [-f|--flight-recorder[=file]] "
+			"[-s|--state-page[=file]] <config>\n", name);
+}
+
 int main(int argc, char **argv)
 {
-	if (argc != 2) {
-		LOGE("Usage: %s <config>\n", argv[0]);
+	int actuator = 0;
+	int uring = 0;
+	int realtime = 0;
+	int cpu = -1;
+	int recorder = 0;
+	const char *recorder_path = NULL;
+	int state = 0;
+	const char *state_path = NULL;
+	char *end;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "aur::f::s::", options,
+			NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			actuator = 1;
+			break;
+		case 'u':
+			uring = 1;
+			break;
+		case 'r':
+			realtime = 1;
+			if (optarg == NULL)
+				break;
+			cpu = strtol(optarg, &end, 10);
+			if (*end || cpu < 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'f':
+			recorder = 1;
+			recorder_path = optarg;
+			break;
+		case 's':
+			state = 1;
+			state_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
 		return -1;
 	}
 
-	if (parse(argv[1]))
+	if (parse(argv[optind]))
 		return -1;
 
+	if (recorder && recorder_start(recorder_path))
+		LOGW("running without flight recorder\n");
+
+	if (state && state_start(state_path))
+		LOGW("running without state page\n");
+
+	/* fall back to logging synchronously */
+	if (log_start())
+		LOGW("logger thread unavailable\n");
+
+	/* fall back to reading each resource when it is sampled */
+	if (uring && resource_manager_batch_start())
+		LOGW("batched reads unavailable\n");
+
+	/* fall back to writing from the main loop */
+	if (actuator && actuator_start())
+		LOGW("actuator thread unavailable\n");
+
+	/* after the threads above are started, so they keep SCHED_OTHER */
+	if (realtime) {
+		if (realtime_enter(cpu))
+			LOGW("running without full real-time guarantees\n");
+		configuration_manager_check_allocs();
+	}
+
 	configuration_manager_run();
 
+	actuator_stop();
+	log_stop();
+
 	return 0;
 }
@@ -1,11 +1,17 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <limits.h>
 
+#include "log.h"
 #include "resource.h"
+#include "actuator.h"
 #include "mitigation.h"
 
 struct mitigation_resource {
 	char target_value[256];
+	int target_int;
+	int numeric;
 	struct resource *resource;
 	struct list_node list_node;
 };
@@ -37,24 +43,117 @@ void mitigation_destroy(struct mitigation *m)
 	free(m);
 }
 
-void mitigation_add_resource(struct mitigation *m, const char *name, const char *target_value)
+static struct mitigation_resource *mitigation_resource_attach(
+		struct mitigation *m, struct resource *res)
 {
 	struct mitigation_resource *r;
+
+	r = calloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	r->resource = res;
+
+	list_append(&m->resources, &r->list_node);
+	return r;
+}
+
+static struct mitigation_resource *mitigation_resource_create(
+		struct mitigation *m, const char *name)
+{
 	struct resource *res;
 
 	res = resource_manager_find(name);
 	if (res == NULL)
-		return;
+		return NULL;
+	return mitigation_resource_attach(m, res);
+}
 
-	r = calloc(1, sizeof(*r));
+void mitigation_add_resource(struct mitigation *m, const char *name, const char *target_value)
+{
+	struct mitigation_resource *r;
+	char *end;
+	long lvalue;
+	int value;
+
+	r = mitigation_resource_create(m, name);
 	if (r == NULL)
 		return;
+
+	/*
+	 * Snap numeric targets to a value the resource supports up front.
+	 * Resources without resolve_value get the string as written, so
+	 * large, hex or zero padded values reach plain files unchanged.
+	 */
+	lvalue = strtol(target_value, &end, 0);
+	value = lvalue;
+	if (r->resource->resolve_value != NULL &&
+			end != target_value && *end == 0 &&
+			lvalue >= INT_MIN && lvalue <= INT_MAX &&
+			resource_resolve_value(r->resource,
+				RESOURCE_UNIT_ABSOLUTE, value, &value) == 0) {
+		snprintf(r->target_value, sizeof(r->target_value), "%d", value);
+		r->target_int = value;
+		r->numeric = 1;
+		if (strcmp(r->target_value, target_value))
+			LOGV("%s: %s snapped to %s\n", name, target_value,
+					r->target_value);
+		return;
+	}
+
 	strncpy(r->target_value, target_value, sizeof(r->target_value));
 	r->target_value[sizeof(r->target_value) - 1] = 0;
+}
 
-	r->resource = res;
+static void mitigation_add_resolved(struct mitigation *m,
+		struct resource *res, enum resource_unit unit, int value)
+{
+	struct mitigation_resource *r;
+	struct resource **members;
+	const char *name = res->name;
+	int resolved;
+	int count;
+	int i;
+
+	/*
+	 * Members of a union may differ, like big and LITTLE cpufreq or
+	 * cooling devices with a different max_state, so relative values are
+	 * resolved and written for each member on its own.
+	 */
+	count = resource_union_members(res, &members);
+	if (count >= 0) {
+		for (i = 0; i < count; ++i)
+			mitigation_add_resolved(m, members[i], unit, value);
+		return;
+	}
 
-	list_append(&m->resources, &r->list_node);
+	r = mitigation_resource_attach(m, res);
+	if (r == NULL)
+		return;
+
+	if (resource_resolve_value(r->resource, unit, value, &resolved)) {
+		LOGW("%s: unable to resolve relative value %d\n", name, value);
+		list_remove(&m->resources, &r->list_node);
+		free(r);
+		return;
+	}
+
+	snprintf(r->target_value, sizeof(r->target_value), "%d", resolved);
+	r->target_int = resolved;
+	r->numeric = 1;
+	LOGV("%s: %d%s resolved to %d\n", name, value,
+			unit == RESOURCE_UNIT_PERCENT ? "%" : " (index)",
+			resolved);
+}
+
+void mitigation_add_resource_unit(struct mitigation *m, const char *name,
+		enum resource_unit unit, int value)
+{
+	struct resource *res;
+
+	res = resource_manager_find(name);
+	if (res == NULL)
+		return;
+	mitigation_add_resolved(m, res, unit, value);
 }
 
 void mitigation_activate(struct mitigation *m)
@@ -65,7 +164,11 @@ void mitigation_activate(struct mitigation *m)
 	for_list_node(&m->resources, node) {
 		r = list_entry(node, struct mitigation_resource, list_node);
 		resource_enable(r->resource);
-		resource_write_value(r->resource, r->target_value, strlen(r->target_value));
+		if (r->numeric && r->resource->write_int != NULL)
+			actuator_write_int(r->resource, r->target_int);
+		else
+			actuator_write_value(r->resource, r->target_value,
+					strlen(r->target_value));
 	}
 }
 
@@ -2,6 +2,7 @@
 #define _MITIGATION_H_
 
 #include "list.h"
+#include "resource.h"
 
 struct mitigation {
 	struct list resources;
@@ -14,6 +15,8 @@ void mitigation_destroy(struct mitigation *m);
 
 void mitigation_add_resource(struct mitigation *m,
 		const char *name, const char *target_value);
+void mitigation_add_resource_unit(struct mitigation *m,
+		const char *name, enum resource_unit unit, int value);
 void mitigation_activate(struct mitigation *m);
 void mitigation_deactivate(struct mitigation *m);
 
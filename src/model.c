@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "util.h"
+#include "watch.h"
+#include "model.h"
+
+#define MODEL_MAX_NODES 16
+#define MODEL_MAX_LINKS 32
+#define MODEL_MAX_ELAPSED_MS 10000
+#define MODEL_DEFAULT_TEMP 25000
+
+/*
+ * A lumped RC thermal network.  Mass nodes have a heat capacity and
+ * optionally a power input, fixed nodes hold a constant temperature and
+ * driven nodes follow the value of another resource.  Links are thermal
+ * resistances between two nodes.
+ *
+ * Units are m°C for temperatures, mW for power, mJ/K for capacitance and
+ * mK/W for resistance.  Power inputs are read in µW, like "powercap".  Node temperatures are kept in µ°C so that small
+ * steps do not vanish in the integer arithmetic.  The network is stepped
+ * by forward Euler on every read, in substeps short enough to be stable
+ * for the smallest time constant of the network.
+ */
+enum model_node_type {
+	MODEL_NODE_MASS,
+	MODEL_NODE_FIXED,
+	MODEL_NODE_DRIVEN,
+};
+
+struct model_node {
+	char name[64];
+	enum model_node_type type;
+	int capacitance;
+	char resource_name[256];
+	struct resource *resource;
+	char power_name[256];
+	struct resource *power;
+	int power_mw;
+	long long temp;
+	long long heat;
+	int initialized;
+};
+
+struct model_link {
+	int from;
+	int to;
+	int resistance;
+};
+
+struct model {
+	struct resource resource;
+	struct watch_ticket *ticket;
+	unsigned int interval;
+	unsigned int substep;
+	unsigned long long last_ms;
+	int started;
+	int output;
+	int nnodes;
+	int nlinks;
+	struct model_node nodes[MODEL_MAX_NODES];
+	struct model_link links[MODEL_MAX_LINKS];
+};
+
+static int model_find_node(struct model *m, const char *name)
+{
+	int i;
+
+	for (i = 0; i < m->nnodes; ++i) {
+		if (!strcmp(m->nodes[i].name, name))
+			return i;
+	}
+	return -1;
+}
+
+static void model_read_inputs(struct model *m)
+{
+	struct model_node *n;
+	int value;
+	int i;
+
+	for (i = 0; i < m->nnodes; ++i) {
+		n = &m->nodes[i];
+		if (n->type == MODEL_NODE_DRIVEN &&
+				resource_sample(n->resource, &value) == 0)
+			n->temp = value * 1000LL;
+		if (n->power != NULL &&
+				resource_sample(n->power, &value) == 0)
+			n->power_mw = value / 1000;
+	}
+}
+
+static void model_start(struct model *m)
+{
+	struct model_node *n;
+	long long sum;
+	int count;
+	int i;
+
+	model_read_inputs(m);
+
+	sum = count = 0;
+	for (i = 0; i < m->nnodes; ++i) {
+		n = &m->nodes[i];
+		if (n->type != MODEL_NODE_MASS) {
+			sum += n->temp;
+			count++;
+		}
+	}
+
+	for (i = 0; i < m->nnodes; ++i) {
+		n = &m->nodes[i];
+		if (n->type != MODEL_NODE_MASS || n->initialized)
+			continue;
+		n->temp = count ? sum / count : MODEL_DEFAULT_TEMP * 1000LL;
+		n->initialized = 1;
+	}
+}
+
+static void model_substep(struct model *m, unsigned int dt)
+{
+	struct model_node *n;
+	struct model_link *l;
+	long long q;
+	int i;
+
+	for (i = 0; i < m->nnodes; ++i) {
+		n = &m->nodes[i];
+		n->heat = n->power_mw;
+	}
+
+	/* µ°C over mK/W gives mW */
+	for (i = 0; i < m->nlinks; ++i) {
+		l = &m->links[i];
+		q = (m->nodes[l->from].temp - m->nodes[l->to].temp) /
+				l->resistance;
+		m->nodes[l->from].heat -= q;
+		m->nodes[l->to].heat += q;
+	}
+
+	/* mW times ms over mJ/K gives m°C, scaled to µ°C */
+	for (i = 0; i < m->nnodes; ++i) {
+		n = &m->nodes[i];
+		if (n->type == MODEL_NODE_MASS)
+			n->temp += n->heat * dt * 1000 / n->capacitance;
+	}
+}
+
+static void model_step(struct model *m)
+{
+	unsigned long long now;
+	unsigned long long elapsed;
+	unsigned int dt;
+
+	now = util_time_ms();
+	if (!m->started) {
+		model_start(m);
+		m->last_ms = now;
+		m->started = 1;
+		return;
+	}
+
+	elapsed = now - m->last_ms;
+	if (elapsed == 0)
+		return;
+	m->last_ms = now;
+	if (elapsed > MODEL_MAX_ELAPSED_MS)
+		elapsed = MODEL_MAX_ELAPSED_MS;
+
+	model_read_inputs(m);
+	while (elapsed) {
+		dt = elapsed < m->substep ? elapsed : m->substep;
+		model_substep(m, dt);
+		elapsed -= dt;
+	}
+}
+
+static int model_read_int(struct resource *res, int *value)
+{
+	struct model *m = container_of(res, struct model, resource);
+
+	model_step(m);
+	*value = m->nodes[m->output].temp / 1000;
+	return 0;
+}
+
+static int model_read_value(struct resource *res, char *buf, unsigned int len)
+{
+	int value;
+
+	model_read_int(res, &value);
+	return snprintf(buf, len, "%d", value);
+}
+
+/*
+ * Explicit Euler is stable as long as a substep stays well below the time
+ * constant of every mass node.  The parallel resistance seen by a node is
+ * at least its smallest link resistance divided by its number of links.
+ */
+static unsigned int model_substep_ms(struct model *m)
+{
+	unsigned long long tau, min_tau;
+	int min_r, links;
+	int i, j;
+
+	min_tau = m->interval ? m->interval : 1000;
+	for (i = 0; i < m->nnodes; ++i) {
+		if (m->nodes[i].type != MODEL_NODE_MASS)
+			continue;
+		min_r = 0;
+		links = 0;
+		for (j = 0; j < m->nlinks; ++j) {
+			if (m->links[j].from != i && m->links[j].to != i)
+				continue;
+			if (links++ == 0 || m->links[j].resistance < min_r)
+				min_r = m->links[j].resistance;
+		}
+		if (links == 0)
+			continue;
+		/* mJ/K times mK/W gives µs */
+		tau = (unsigned long long)m->nodes[i].capacitance * min_r /
+				links / 1000;
+		if (tau < min_tau)
+			min_tau = tau;
+	}
+
+	return min_tau / 4 ? min_tau / 4 : 1;
+}
+
+static int model_prepare(struct resource *res)
+{
+	struct model *m = container_of(res, struct model, resource);
+	struct model_node *n;
+	int i;
+
+	for (i = 0; i < m->nnodes; ++i) {
+		n = &m->nodes[i];
+		if (n->resource_name[0]) {
+			n->resource = resource_manager_find(n->resource_name);
+			if (n->resource == NULL) {
+				LOGE("%s: no resource \"%s\" for node %s\n",
+						res->name, n->resource_name,
+						n->name);
+				return -1;
+			}
+		}
+		if (n->power_name[0]) {
+			n->power = resource_manager_find(n->power_name);
+			if (n->power == NULL) {
+				LOGE("%s: no resource \"%s\" for node %s\n",
+						res->name, n->power_name,
+						n->name);
+				return -1;
+			}
+		}
+	}
+
+	if (m->nnodes == 0) {
+		LOGE("%s: model has no nodes\n", res->name);
+		return -1;
+	}
+
+	m->substep = model_substep_ms(m);
+	LOGV("%s: %d nodes, %d links, %u ms substep\n", res->name,
+			m->nnodes, m->nlinks, m->substep);
+
+	return 0;
+}
+
+static void model_enable(struct resource *res)
+{
+	struct model *m = container_of(res, struct model, resource);
+	int i;
+
+	for (i = 0; i < m->nnodes; ++i) {
+		if (m->nodes[i].resource != NULL)
+			resource_enable(m->nodes[i].resource);
+		if (m->nodes[i].power != NULL)
+			resource_enable(m->nodes[i].power);
+	}
+	if (m->ticket == NULL && m->interval)
+		m->ticket = watch_manager_add_timeout(m->interval);
+	else if (m->ticket != NULL && watch_ticket_is_null(m->ticket))
+		watch_ticket_set_timeout(m->ticket, m->interval);
+}
+
+static void model_disable(struct resource *res)
+{
+	struct model *m = container_of(res, struct model, resource);
+	int i;
+
+	if (m->ticket != NULL)
+		watch_ticket_set_null(m->ticket);
+	for (i = 0; i < m->nnodes; ++i) {
+		if (m->nodes[i].resource != NULL)
+			resource_disable(m->nodes[i].resource);
+		if (m->nodes[i].power != NULL)
+			resource_disable(m->nodes[i].power);
+	}
+}
+
+static void model_close(struct resource *res)
+{
+	struct model *m = container_of(res, struct model, resource);
+
+	if (m->ticket != NULL)
+		watch_ticket_delete(m->ticket);
+	free(m);
+}
+
+struct resource *model_create(const char *name, unsigned int interval)
+{
+	struct model *m;
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL)
+		return NULL;
+
+	m->interval = interval;
+	m->output = -1;
+
+	m->resource.prepare = model_prepare;
+	m->resource.enable = model_enable;
+	m->resource.disable = model_disable;
+	m->resource.close = model_close;
+	m->resource.read_value = model_read_value;
+	m->resource.read_int = model_read_int;
+
+	strncpy(m->resource.name, name, sizeof(m->resource.name));
+	m->resource.name[sizeof(m->resource.name) - 1] = 0;
+
+	return &m->resource;
+}
+
+static struct model_node *model_new_node(struct model *m, const char *name,
+		enum model_node_type type)
+{
+	struct model_node *n;
+
+	if (m->nnodes == MODEL_MAX_NODES) {
+		LOGE("%s: too many nodes\n", m->resource.name);
+		return NULL;
+	}
+	if (model_find_node(m, name) >= 0) {
+		LOGE("%s: duplicate node %s\n", m->resource.name, name);
+		return NULL;
+	}
+
+	n = &m->nodes[m->nnodes];
+	strncpy(n->name, name, sizeof(n->name));
+	n->name[sizeof(n->name) - 1] = 0;
+	n->type = type;
+
+	/* the last node added is the output unless told otherwise */
+	m->output = m->nnodes++;
+
+	return n;
+}
+
+int model_add_mass(struct resource *res, const char *name,
+		int capacitance, int temp, const char *power)
+{
+	struct model *m = container_of(res, struct model, resource);
+	struct model_node *n;
+
+	if (capacitance <= 0) {
+		LOGE("%s: node %s needs a positive capacitance\n",
+				res->name, name);
+		return -1;
+	}
+
+	n = model_new_node(m, name, MODEL_NODE_MASS);
+	if (n == NULL)
+		return -1;
+
+	n->capacitance = capacitance;
+	if (temp != MODEL_TEMP_UNSET) {
+		n->temp = temp * 1000LL;
+		n->initialized = 1;
+	}
+	if (power != NULL) {
+		strncpy(n->power_name, power, sizeof(n->power_name));
+		n->power_name[sizeof(n->power_name) - 1] = 0;
+	}
+
+	return 0;
+}
+
+int model_add_fixed(struct resource *res, const char *name, int temp)
+{
+	struct model *m = container_of(res, struct model, resource);
+	struct model_node *n;
+
+	n = model_new_node(m, name, MODEL_NODE_FIXED);
+	if (n == NULL)
+		return -1;
+
+	n->temp = temp * 1000LL;
+	return 0;
+}
+
+int model_add_driven(struct resource *res, const char *name,
+		const char *resource)
+{
+	struct model *m = container_of(res, struct model, resource);
+	struct model_node *n;
+
+	n = model_new_node(m, name, MODEL_NODE_DRIVEN);
+	if (n == NULL)
+		return -1;
+
+	strncpy(n->resource_name, resource, sizeof(n->resource_name));
+	n->resource_name[sizeof(n->resource_name) - 1] = 0;
+	return 0;
+}
+
+int model_add_link(struct resource *res, const char *from, const char *to,
+		int resistance)
+{
+	struct model *m = container_of(res, struct model, resource);
+	struct model_link *l;
+	int a, b;
+
+	a = model_find_node(m, from);
+	b = model_find_node(m, to);
+	if (a < 0 || b < 0 || a == b) {
+		LOGE("%s: bad link %s - %s\n", res->name, from, to);
+		return -1;
+	}
+	if (resistance <= 0) {
+		LOGE("%s: link %s - %s needs a positive resistance\n",
+				res->name, from, to);
+		return -1;
+	}
+	if (m->nlinks == MODEL_MAX_LINKS) {
+		LOGE("%s: too many links\n", res->name);
+		return -1;
+	}
+
+	l = &m->links[m->nlinks++];
+	l->from = a;
+	l->to = b;
+	l->resistance = resistance;
+
+	return 0;
+}
+
+int model_set_output(struct resource *res, const char *name)
+{
+	struct model *m = container_of(res, struct model, resource);
+	int i;
+
+	i = model_find_node(m, name);
+	if (i < 0) {
+		LOGE("%s: no output node %s\n", res->name, name);
+		return -1;
+	}
+	m->output = i;
+	return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef _MODEL_H_
+#define _MODEL_H_
+
+#include <limits.h>
+
+#include "resource.h"
+
+/* no initial temperature given, start from the boundary nodes */
+#define MODEL_TEMP_UNSET INT_MIN
+
+struct resource *model_create(const char *name, unsigned int interval);
+int model_add_mass(struct resource *res, const char *name,
+		int capacitance, int temp, const char *power);
+int model_add_fixed(struct resource *res, const char *name, int temp);
+int model_add_driven(struct resource *res, const char *name,
+		const char *resource);
+int model_add_link(struct resource *res, const char *from, const char *to,
+		int resistance);
+int model_set_output(struct resource *res, const char *name);
+
+#endif
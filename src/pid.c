@@ -0,0 +1,194 @@
+#include <stdlib.h>
+
+#include "log.h"
+#include "util.h"
+#include "control.h"
+#include "resource.h"
+#include "actuator.h"
+#include "pid.h"
+
+/*
+ * Closed-loop control holding the sensor at a setpoint.  The controller
+ * output is the amount of mitigation, from 0 up to range.  It is either
+ * quantized to a level of a control, which is voted for like a threshold
+ * would, or subtracted from max and snapped to a value the resource
+ * supports.  Integration stops while the output is saturated, so the
+ * integral does not wind up.
+ */
+struct pid {
+	struct configuration configuration;
+	struct pid_gains gains;
+	int setpoint;
+	double range;
+	double integral;
+	unsigned long long last_time;
+	int last_input;
+
+	struct control *control;
+	int level;
+
+	struct resource *resource;
+	int min;
+	int max;
+	int output;
+};
+
+static double pid_step(struct pid *p, int value)
+{
+	unsigned long long now;
+	double error;
+	double deriv;
+	double out;
+	double dt;
+
+	now = util_time_ms();
+	error = value - p->setpoint;
+	if (p->last_time == 0) {
+		dt = 0;
+		deriv = 0;
+	} else {
+		dt = (now - p->last_time) / 1000.0;
+		deriv = dt > 0 ? (value - p->last_input) / dt : 0;
+	}
+	p->last_time = now;
+	p->last_input = value;
+
+	out = p->gains.kp * error + p->gains.ki * p->integral +
+			p->gains.kd * deriv;
+
+	/* conditional integration, only while it moves out of saturation */
+	if (!((out >= p->range && error > 0) || (out <= 0 && error < 0))) {
+		p->integral += error * dt;
+		out += p->gains.ki * error * dt;
+	}
+	if (p->gains.ki > 0) {
+		if (p->integral * p->gains.ki > p->range)
+			p->integral = p->range / p->gains.ki;
+		if (p->integral < 0)
+			p->integral = 0;
+	}
+
+	if (out < 0)
+		out = 0;
+	if (out > p->range)
+		out = p->range;
+	return out;
+}
+
+static void pid_run_control(struct configuration *cfg, int value)
+{
+	struct pid *p = container_of(cfg, struct pid, configuration);
+	int level;
+
+	cfg->last_value = value;
+	level = control_floor_level(p->control, (int)(pid_step(p, value) + 0.5));
+	if (level == p->level)
+		return;
+
+	control_vote_level(p->control, level);
+	if (p->level >= 0)
+		control_unvote_level(p->control, p->level);
+	p->level = level;
+}
+
+static void pid_run_resource(struct configuration *cfg, int value)
+{
+	struct pid *p = container_of(cfg, struct pid, configuration);
+	int output;
+
+	cfg->last_value = value;
+	output = p->max - (int)(pid_step(p, value) + 0.5);
+	if (resource_resolve_value(p->resource, RESOURCE_UNIT_ABSOLUTE,
+			output, &output))
+		return;
+	if (output == p->output)
+		return;
+
+	if (p->output == -1)
+		resource_enable(p->resource);
+	p->output = output;
+	actuator_write_int(p->resource, output);
+}
+
+static void pid_destroy(struct configuration *cfg)
+{
+	struct pid *p = container_of(cfg, struct pid, configuration);
+
+	if (p->control != NULL && p->level >= 0)
+		control_unvote_level(p->control, p->level);
+	if (p->resource != NULL && p->output != -1)
+		resource_disable(p->resource);
+	free(p);
+}
+
+static struct pid *pid_create(const char *sensor, int setpoint,
+		const struct pid_gains *gains, unsigned int interval)
+{
+	struct pid *p;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return NULL;
+
+	if (configuration_init(&p->configuration, sensor)) {
+		free(p);
+		return NULL;
+	}
+
+	p->gains = *gains;
+	p->setpoint = setpoint;
+	p->level = -1;
+	p->output = -1;
+	p->configuration.interval = interval;
+	p->configuration.kind = "pid";
+	p->configuration.destroy = pid_destroy;
+
+	return p;
+}
+
+struct configuration *pid_create_control(const char *sensor,
+		const char *control, int setpoint, const struct pid_gains *gains,
+		unsigned int interval)
+{
+	struct pid *p;
+
+	p = pid_create(sensor, setpoint, gains, interval);
+	if (p == NULL)
+		return NULL;
+
+	p->control = control_manager_find(control);
+	if (p->control == NULL) {
+		free(p);
+		return NULL;
+	}
+	p->range = control_max_level(p->control);
+	p->configuration.run = pid_run_control;
+
+	return &p->configuration;
+}
+
+struct configuration *pid_create_resource(const char *sensor,
+		const char *resource, int setpoint, const struct pid_gains *gains,
+		int min, int max, unsigned int interval)
+{
+	struct pid *p;
+
+	if (max <= min)
+		return NULL;
+
+	p = pid_create(sensor, setpoint, gains, interval);
+	if (p == NULL)
+		return NULL;
+
+	p->resource = resource_manager_find(resource);
+	if (p->resource == NULL) {
+		free(p);
+		return NULL;
+	}
+	p->min = min;
+	p->max = max;
+	p->range = max - min;
+	p->configuration.run = pid_run_resource;
+
+	return &p->configuration;
+}
@@ -0,0 +1,19 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+#include "configuration.h"
+
+struct pid_gains {
+	double kp;
+	double ki;
+	double kd;
+};
+
+struct configuration *pid_create_control(const char *sensor,
+		const char *control, int setpoint, const struct pid_gains *gains,
+		unsigned int interval);
+struct configuration *pid_create_resource(const char *sensor,
+		const char *resource, int setpoint, const struct pid_gains *gains,
+		int min, int max, unsigned int interval);
+
+#endif
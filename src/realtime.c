@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "log.h"
+#include "realtime.h"
+
+/* lowest SCHED_FIFO priority, enough to preempt every SCHED_OTHER task */
+#define REALTIME_PRIORITY 1
+#define REALTIME_STACK_SIZE (64 * 1024)
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+/*
+ * On glibc the allocator entry points are wrapped to count the
+ * allocations made by each thread, so the main loop can check that it
+ * runs without allocating once it has settled.  Allocations made by
+ * glibc itself do not go through these and are not counted.
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static __thread unsigned long g_realtime_allocs;
+
+void *malloc(size_t size)
+{
+	g_realtime_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	g_realtime_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	g_realtime_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	g_realtime_allocs++;
+	return __libc_memalign(alignment, size);
+}
+
+int realtime_alloc_count(unsigned long *count)
+{
+	*count = g_realtime_allocs;
+	return 0;
+}
+#else
+int realtime_alloc_count(unsigned long *count)
+{
+	*count = 0;
+	return -1;
+}
+#endif
+
+static void realtime_prefault_stack(void)
+{
+	volatile char stack[REALTIME_STACK_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+/*
+ * Locks all current and future memory, prefaults the stack and moves the
+ * calling thread to SCHED_FIFO, pinned to cpu unless it is negative.
+ * Children such as intents are spawned with the default policy again.
+ */
+int realtime_enter(int cpu)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int rc = 0;
+
+#ifdef __GLIBC__
+	/* keep freed memory in the (locked) heap instead of unmapping it */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		LOGW("unable to lock memory: %s\n", strerror(errno));
+		rc = -1;
+	}
+	realtime_prefault_stack();
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = REALTIME_PRIORITY;
+	if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param)) {
+		LOGW("unable to set SCHED_FIFO: %s\n", strerror(errno));
+		rc = -1;
+	}
+
+	if (cpu >= CPU_SETSIZE) {
+		LOGW("unable to pin to cpu %d: out of range\n", cpu);
+		rc = -1;
+	} else if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			LOGW("unable to pin to cpu %d: %s\n", cpu, strerror(errno));
+			rc = -1;
+		}
+	}
+
+	return rc;
+}
@@ -0,0 +1,7 @@
+#ifndef _REALTIME_H_
+#define _REALTIME_H_
+
+int realtime_enter(int cpu);
+int realtime_alloc_count(unsigned long *count);
+
+#endif
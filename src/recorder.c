@@ -0,0 +1,139 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "util.h"
+#include "resource.h"
+#include "control.h"
+#include "recorder.h"
+
+/*
+ * The flight recorder keeps the last RECORDER_RECORDS samples, edge
+ * changes, votes and level transitions in a shared memory region, so
+ * tools can follow thermanager by mapping it instead of reading sysfs
+ * themselves.  All events are recorded from the main loop, so the ring
+ * has a single writer and recording a record is a handful of stores.
+ */
+static struct recorder_header *g_recorder;
+static struct recorder_name *g_recorder_names;
+static struct recorder_record *g_recorder_records;
+/* name 0 is left empty for objects that did not fit in the table */
+static unsigned int g_recorder_nnames = 1;
+
+int recorder_start(const char *path)
+{
+	unsigned int names_offset;
+	unsigned int records_offset;
+	unsigned int len;
+	void *addr;
+	int fd;
+
+	names_offset = sizeof(struct recorder_header);
+	records_offset = names_offset +
+			RECORDER_NAMES * sizeof(struct recorder_name);
+	len = records_offset +
+			RECORDER_RECORDS * sizeof(struct recorder_record);
+
+	addr = util_shm_create(path, len, &fd);
+	if (addr == NULL) {
+		LOGE("unable to create flight recorder: %s\n", strerror(errno));
+		return -1;
+	}
+
+	g_recorder = addr;
+	g_recorder_names = (struct recorder_name *)
+			((char *)addr + names_offset);
+	g_recorder_records = (struct recorder_record *)
+			((char *)addr + records_offset);
+
+	g_recorder->nnames = RECORDER_NAMES;
+	g_recorder->nrecords = RECORDER_RECORDS;
+	g_recorder->names_offset = names_offset;
+	g_recorder->records_offset = records_offset;
+	g_recorder->pid = getpid();
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(g_recorder->magic, RECORDER_MAGIC, sizeof(g_recorder->magic));
+
+	if (path != NULL)
+		LOGI("recording to %s\n", path);
+	else
+		LOGI("recording to /proc/%d/fd/%d\n", getpid(), fd);
+
+	return 0;
+}
+
+static unsigned int recorder_name(const char *name, unsigned int *id)
+{
+	if (*id == 0 && g_recorder_nnames < RECORDER_NAMES) {
+		*id = g_recorder_nnames++;
+		strncpy(g_recorder_names[*id].name, name,
+				sizeof(g_recorder_names[*id].name) - 1);
+	}
+	return *id;
+}
+
+static void recorder_write(unsigned int type, unsigned int id,
+		int value, int arg)
+{
+	struct recorder_record *r;
+	uint32_t n;
+
+	n = g_recorder->head;
+	r = &g_recorder_records[n % RECORDER_RECORDS];
+
+	/* invalidate the record while it is rewritten */
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r->type = type;
+	r->id = id;
+	r->time_us = util_time_us();
+	r->value = value;
+	r->arg = arg;
+
+	__atomic_store_n(&r->seq, n + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&g_recorder->head, n + 1, __ATOMIC_RELEASE);
+}
+
+void recorder_sample(struct resource *res, int value, int rc)
+{
+	if (g_recorder == NULL)
+		return;
+	recorder_write(RECORDER_SAMPLE,
+			recorder_name(res->name, &res->record_id), value, rc);
+}
+
+void recorder_edges(struct resource *res, int lower, int upper)
+{
+	if (g_recorder == NULL)
+		return;
+	recorder_write(RECORDER_EDGES,
+			recorder_name(res->name, &res->record_id), lower, upper);
+}
+
+void recorder_vote(struct control *ctrl, int level, int vote)
+{
+	if (g_recorder == NULL)
+		return;
+	recorder_write(vote ? RECORDER_VOTE : RECORDER_UNVOTE,
+			recorder_name(ctrl->name, &ctrl->record_id), level, 0);
+}
+
+void recorder_level(struct control *ctrl, int level, int previous)
+{
+	if (g_recorder == NULL)
+		return;
+	recorder_write(RECORDER_LEVEL,
+			recorder_name(ctrl->name, &ctrl->record_id),
+			level, previous);
+}
+
+void recorder_avoided(struct resource *res, unsigned int avoided, int raw)
+{
+	if (g_recorder == NULL)
+		return;
+	recorder_write(RECORDER_AVOIDED,
+			recorder_name(res->name, &res->record_id),
+			avoided, raw);
+}
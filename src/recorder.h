@@ -0,0 +1,59 @@
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdint.h>
+
+#define RECORDER_MAGIC "THMREC1"
+#define RECORDER_NAMES 256
+#define RECORDER_RECORDS 4096
+
+enum recorder_type {
+	RECORDER_SAMPLE = 1,	/* value, arg is 0 or -1 on a failed read */
+	RECORDER_EDGES,		/* value is the lower, arg the upper edge */
+	RECORDER_VOTE,		/* value is the level voted for */
+	RECORDER_UNVOTE,	/* value is the level no longer voted for */
+	RECORDER_LEVEL,		/* value is the new, arg the previous level */
+	RECORDER_AVOIDED,	/* value is the avoided count, arg the raw value */
+};
+
+/*
+ * Layout of the recorder region: a header, a table of names indexed by
+ * the id of a record, and a ring of records.  Record n is stored at
+ * records[n % nrecords] and head is the number of records written.  A
+ * record is valid when its seq reads n + 1 both before and after its
+ * other fields are read.
+ */
+struct recorder_record {
+	uint32_t seq;
+	uint16_t type;
+	uint16_t id;
+	uint64_t time_us;
+	int32_t value;
+	int32_t arg;
+};
+
+struct recorder_header {
+	char magic[8];
+	uint32_t nnames;
+	uint32_t nrecords;
+	uint32_t names_offset;
+	uint32_t records_offset;
+	uint32_t head;
+	uint32_t pid;
+};
+
+struct recorder_name {
+	char name[64];
+};
+
+struct resource;
+struct control;
+
+int recorder_start(const char *path);
+void recorder_sample(struct resource *res, int value, int rc);
+void recorder_edges(struct resource *res, int lower, int upper);
+void recorder_vote(struct control *ctrl, int level, int vote);
+void recorder_level(struct control *ctrl, int level, int previous);
+void recorder_avoided(struct resource *res, unsigned int avoided, int raw);
+
+#endif
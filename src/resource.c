@@ -4,18 +4,30 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
-#include <sys/wait.h>
 
 #include "log.h"
 #include "list.h"
 #include "watch.h"
 #include "thermal_zone.h"
 #include "cpufreq.h"
+#include "devfreq.h"
+#include "hotplug.h"
+#include "intent.h"
+#include "uring.h"
+#include "recorder.h"
 #include "util.h"
 #include "resource.h"
 
 static LIST(g_resource_manager_list);
 
+static void resource_manager_batch_sample(unsigned int prev);
+static unsigned int g_resource_tick;
+
+static struct uring *g_resource_uring;
+static struct resource **g_resource_batch;
+static int *g_resource_batch_due;
+static int g_resource_nbatch;
+
 #define ABS(x) (((x)<0)?-(x):(x))
 #define MIN(x,y) (((x)<(y))?(x):(y))
 
@@ -59,6 +71,125 @@ void resource_manager_prepare(void)
 	}
 }
 
+/*
+ * Starts a new sampling tick.  Within a tick, resource_sample() reads each
+ * resource once and hands out the cached value to every other user.
+ */
+void resource_manager_tick(void)
+{
+	unsigned int prev = g_resource_tick;
+	unsigned int tick = prev + 1;
+
+	if (tick == 0)
+		tick = 1;
+	/* stored atomically, writes check it from the actuator thread */
+	__atomic_store_n(&g_resource_tick, tick, __ATOMIC_RELAXED);
+	cpufreq_tick();
+	devfreq_tick();
+
+	if (g_resource_uring != NULL && prev != 0)
+		resource_manager_batch_sample(prev);
+}
+
+/*
+ * Returns the current tick to resources that skip writing a value they
+ * already wrote.  That value is only trusted within one tick, since the
+ * kernel or another service may change it behind our back.
+ */
+static unsigned int resource_write_tick(void)
+{
+	return __atomic_load_n(&g_resource_tick, __ATOMIC_RELAXED);
+}
+
+/*
+ * Reads every batched resource that was sampled during the previous tick
+ * with one io_uring submission, and stores the values as samples of the
+ * new tick.  Other resources are still read when first sampled.
+ */
+static void resource_manager_batch_sample(unsigned int prev)
+{
+	struct resource *res;
+	const char *buf;
+	int ndue = 0;
+	int rc;
+	int i;
+
+	for (i = 0; i < g_resource_nbatch; ++i) {
+		if (g_resource_batch[i]->sample_tick == prev)
+			g_resource_batch_due[ndue++] = i;
+	}
+	if (ndue == 0 || uring_read(g_resource_uring, g_resource_batch_due,
+			ndue))
+		return;
+
+	for (i = 0; i < ndue; ++i) {
+		res = g_resource_batch[g_resource_batch_due[i]];
+		buf = uring_result(g_resource_uring,
+				g_resource_batch_due[i], &rc);
+		res->sample_tick = g_resource_tick;
+		/* cache a failure too, rather than reading again this tick */
+		if (rc <= 0) {
+			res->sample_rc = -1;
+			recorder_sample(res, res->sample_value, -1);
+			continue;
+		}
+		res->sample_value = strtol(buf, 0, 0);
+		res->sample_rc = 0;
+		recorder_sample(res, res->sample_value, 0);
+		if (res->read_complete != NULL)
+			res->read_complete(res, res->sample_value);
+	}
+}
+
+int resource_manager_batch_start(void)
+{
+	struct list_node *iter;
+	struct resource *res;
+	int *fds;
+	int count;
+
+	count = 0;
+	for_list_node(&g_resource_manager_list, iter) {
+		res = list_entry(iter, struct resource, list_node);
+		if (res->read_fd != NULL)
+			count++;
+	}
+	if (count == 0)
+		return -1;
+
+	g_resource_batch = calloc(count, sizeof(g_resource_batch[0]));
+	g_resource_batch_due = calloc(count, sizeof(g_resource_batch_due[0]));
+	fds = calloc(count, sizeof(fds[0]));
+	if (g_resource_batch == NULL || g_resource_batch_due == NULL ||
+			fds == NULL)
+		goto fail;
+
+	count = 0;
+	for_list_node(&g_resource_manager_list, iter) {
+		res = list_entry(iter, struct resource, list_node);
+		if (res->read_fd == NULL)
+			continue;
+		g_resource_batch[count] = res;
+		fds[count++] = res->read_fd(res);
+	}
+
+	g_resource_uring = uring_create(fds, count, 32);
+	free(fds);
+	if (g_resource_uring == NULL)
+		goto fail;
+
+	g_resource_nbatch = count;
+	LOGI("batching reads of %d resources through io_uring\n", count);
+	return 0;
+
+fail:
+	free(g_resource_batch);
+	free(g_resource_batch_due);
+	g_resource_batch = NULL;
+	g_resource_batch_due = NULL;
+	return -1;
+}
+
 void resource_close(struct resource *res)
 {
 	if (res->close == NULL)
@@ -94,11 +225,13 @@ int resource_read_value(struct resource *res, char *buf, unsigned int len)
 	return res->read_value(res, buf, len);
 }
 
-int resource_read_int(struct resource *res)
+int resource_read_int(struct resource *res, int *value)
 {
 	char buf[13];
 	int rc;
 
+	if (res->read_int != NULL)
+		return res->read_int(res, value);
 	if (res->read_value == NULL)
 		return -1;
 
@@ -107,7 +240,26 @@ int resource_read_int(struct resource *res)
 		return -1;
 
 	buf[rc] = 0;
-	return strtol(buf, 0, 0);
+	*value = strtol(buf, 0, 0);
+	return 0;
+}
+
+int resource_sample(struct resource *res, int *value)
+{
+	int rc;
+
+	if (g_resource_tick != 0 && res->sample_tick == g_resource_tick) {
+		*value = res->sample_value;
+		return res->sample_rc;
+	}
+
+	rc = resource_read_int(res, &res->sample_value);
+	res->sample_rc = rc;
+	res->sample_tick = g_resource_tick;
+	recorder_sample(res, res->sample_value, rc);
+
+	*value = res->sample_value;
+	return rc;
 }
 
 int resource_write_int(struct resource *res, int value)
@@ -115,6 +267,8 @@ int resource_write_int(struct resource *res, int value)
 	char buf[13];
 	int rc;
 
+	if (res->write_int != NULL)
+		return res->write_int(res, value);
 	if (res->write_value == NULL)
 		return -1;
 
@@ -129,8 +283,25 @@ int resource_write_value(struct resource *res, const char *val, unsigned int len
 	return res->write_value(res, val, len);
 }
 
+/*
+ * Translates a value given in unit into the absolute value to write to
+ * res, snapping it to something the resource actually supports.
+ */
+int resource_resolve_value(struct resource *res, enum resource_unit unit,
+		int value, int *out)
+{
+	if (res->resolve_value == NULL) {
+		if (unit != RESOURCE_UNIT_ABSOLUTE)
+			return -1;
+		*out = value;
+		return 0;
+	}
+	return res->resolve_value(res, unit, value, out);
+}
+
 void resource_set_edges(struct resource *res, int lower, int upper)
 {
+	recorder_edges(res, lower, upper);
 	if (res->set_edges == NULL)
 		return;
 	res->set_edges(res, lower, upper);
@@ -199,6 +370,20 @@ static int resource_tz_read_value(struct resource *res, char *buf, unsigned int
 	return rc;
 }
 
+static int resource_tz_read_fd(struct resource *res)
+{
+	struct tz_resource *tres =
+			container_of(res, struct tz_resource, resource);
+	return thermal_zone_fd(tres->zone);
+}
+
+static void resource_tz_read_complete(struct resource *res, int value)
+{
+	struct tz_resource *tres =
+			container_of(res, struct tz_resource, resource);
+	tres->value = value;
+}
+
 struct resource *resource_tz_open(const char *name, const char *file)
 {
 	struct tz_resource *res;
@@ -217,6 +402,8 @@ struct resource *resource_tz_open(const char *name, const char *file)
 	res->resource.enable = resource_tz_enable;
 	res->resource.disable = resource_tz_disable;
 	res->resource.set_edges = resource_tz_set_edges;
+	res->resource.read_fd = resource_tz_read_fd;
+	res->resource.read_complete = resource_tz_read_complete;
 
 	res->low_edge = INT_MIN;
 	res->high_edge = INT_MAX;
@@ -237,17 +424,18 @@ static void resource_sysfs_enable(struct resource *res)
 {
 	struct sysfs_resource *sres =
 			container_of(res, struct sysfs_resource, resource);
-	sres->ticket = watch_manager_add_timeout(5000);
+	if (sres->ticket == NULL)
+		sres->ticket = watch_manager_add_timeout(5000);
+	else if (sres->ticket != NULL && watch_ticket_is_null(sres->ticket))
+		watch_ticket_set_timeout(sres->ticket, 5000);
 }
 
 static void resource_sysfs_disable(struct resource *res)
 {
 	struct sysfs_resource *sres =
 			container_of(res, struct sysfs_resource, resource);
-	if (sres->ticket != NULL) {
-		watch_ticket_delete(sres->ticket);
-		sres->ticket = NULL;
-	}
+	if (sres->ticket != NULL)
+		watch_ticket_set_null(sres->ticket);
 }
 
 static void resource_sysfs_close(struct resource *res)
@@ -275,8 +463,8 @@ static int resource_sysfs_read_value(struct resource *res,
 			return -1;
 	}
 #endif
-	rc = read(sres->fd, buf, len);
-	lseek(sres->fd, 0, SEEK_SET);
+	/* pread, the fd may be written by the actuator thread meanwhile */
+	rc = pread(sres->fd, buf, len, 0);
 	return rc;
 }
 
@@ -286,10 +474,17 @@ static int resource_sysfs_write_value(struct resource *res,
 	struct sysfs_resource *sres =
 			container_of(res, struct sysfs_resource, resource);
 	int rc;
-	rc = write(sres->fd, val, len);
+	rc = pwrite(sres->fd, val, len, 0);
 	return -(rc <= 0);
 }
 
+static int resource_sysfs_read_fd(struct resource *res)
+{
+	struct sysfs_resource *sres =
+			container_of(res, struct sysfs_resource, resource);
+	return sres->fd;
+}
+
 struct resource *resource_sysfs_open(const char *name, const char *file,
 		enum resource_sysfs_t sysfs_type)
 {
@@ -325,6 +520,7 @@ struct resource *resource_sysfs_open(const char *name, const char *file,
 	}
 
 	res->resource.read_value = resource_sysfs_read_value;
+	res->resource.read_fd = resource_sysfs_read_fd;
 	res->resource.close = resource_sysfs_close;
 
 	strncpy(res->resource.name, name, sizeof(res->resource.name));
@@ -422,7 +618,8 @@ static int resource_union_read_value(struct resource *res, char *buf, unsigned i
 
 	for (i = 0; i < ures->nmembers; ++i) {
 		int value;
-		value = resource_read_int(ures->members[i]);
+		if (resource_sample(ures->members[i], &value))
+			continue;
 		if (value > max)
 			max = value;
 	}
@@ -442,6 +639,53 @@ static int resource_union_write_value(struct resource *res, const char *val, uns
 	return 0;
 }
 
+static int resource_union_write_int(struct resource *res, int value)
+{
+	struct union_resource *ures =
+			container_of(res, struct union_resource, resource);
+	int i;
+
+	for (i = 0; i < ures->nmembers; ++i) {
+		resource_write_int(ures->members[i], value);
+	}
+	return 0;
+}
+
+/*
+ * Absolute values are left for each member to snap on write.  Relative
+ * values are resolved against the first member here, but mitigations
+ * resolve them for each member, see resource_union_members().
+ */
+static int resource_union_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct union_resource *ures =
+			container_of(res, struct union_resource, resource);
+
+	if (unit == RESOURCE_UNIT_ABSOLUTE) {
+		*out = value;
+		return 0;
+	}
+	if (ures->nmembers == 0)
+		return -1;
+	return resource_resolve_value(ures->members[0], unit, value, out);
+}
+
+/*
+ * Returns the number of members of a union and points members at them, or
+ * -1 when res is not a union.
+ */
+int resource_union_members(struct resource *res, struct resource ***members)
+{
+	struct union_resource *ures;
+
+	if (res->close != resource_union_close)
+		return -1;
+	ures = container_of(res, struct union_resource, resource);
+	*members = ures->members;
+	return ures->members != NULL ? ures->nmembers : 0;
+}
+
 struct resource *resource_union_open(const char *name, int count, const char **names)
 {
 	struct union_resource *res;
@@ -458,6 +702,8 @@ struct resource *resource_union_open(const char *name, int count, const char **n
 	res->resource.close = resource_union_close;
 	res->resource.read_value = resource_union_read_value;
 	res->resource.write_value = resource_union_write_value;
+	res->resource.write_int = resource_union_write_int;
+	res->resource.resolve_value = resource_union_resolve_value;
 	res->nmembers = count;
 
 	res->member_names = calloc(1, sizeof(res->member_names[0]) * count);
@@ -542,6 +788,14 @@ static int resource_alias_write_value(struct resource *res, const char *val, uns
 	return resource_write_value(ares->aliased, val, len);
 }
 
+static int resource_alias_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct alias_resource *ares =
+			container_of(res, struct alias_resource, resource);
+	return resource_resolve_value(ares->aliased, unit, value, out);
+}
+
 struct resource *resource_alias_open(const char *name, const char *aliased)
 {
 	struct alias_resource *res;
@@ -557,6 +811,7 @@ struct resource *resource_alias_open(const char *name, const char *aliased)
 	res->resource.close = resource_alias_close;
 	res->resource.read_value = resource_alias_read_value;
 	res->resource.write_value = resource_alias_write_value;
+	res->resource.resolve_value = resource_alias_resolve_value;
 	strncpy(res->alias_name, aliased, sizeof(res->alias_name));
 	res->alias_name[sizeof(res->alias_name) - 1] = 0;
 
@@ -718,7 +973,8 @@ static int resource_deadband_read_value(struct resource *res, char *buf, unsigne
 			container_of(res, struct deadband_resource, resource);
 	int ival;
 
-	ival = resource_read_int(ares->aliased);
+	if (resource_read_int(ares->aliased, &ival))
+		return -1;
 	if (ABS(ival - ares->lrv) <= ares->deadband)
 		return snprintf(buf, len, "%d", ares->lrv);
 
@@ -740,6 +996,14 @@ static int resource_deadband_write_value(struct resource *res, const char *val,
 	return resource_write_int(ares->aliased, ival);
 }
 
+static int resource_deadband_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct deadband_resource *ares =
+			container_of(res, struct deadband_resource, resource);
+	return resource_resolve_value(ares->aliased, unit, value, out);
+}
+
 struct resource *resource_deadband_open(const char *name,
 		const char *resource, unsigned int deadband)
 {
@@ -756,6 +1020,7 @@ struct resource *resource_deadband_open(const char *name,
 	res->resource.close = resource_deadband_close;
 	res->resource.read_value = resource_deadband_read_value;
 	res->resource.write_value = resource_deadband_write_value;
+	res->resource.resolve_value = resource_deadband_resolve_value;
 	strncpy(res->alias_name, resource, sizeof(res->alias_name));
 	res->alias_name[sizeof(res->alias_name) - 1] = 0;
 
@@ -864,38 +1129,26 @@ struct intent_resource {
 	char intent[256];
 };
 
+static int resource_intent_prepare(struct resource *res)
+{
+	if (intent_open())
+		LOGW("%s: intents will be sent synchronously\n", res->name);
+	return 0;
+}
+
 static int resource_intent_write_value(struct resource *res,
 		const char *val, unsigned int len)
 {
 	struct intent_resource *ares =
 			container_of(res, struct intent_resource, resource);
-	char buf[len + 1];
-	pid_t pid;
+	char buf[256];
 
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
 	memcpy(buf, val, len);
 	buf[len] = 0;
 
-	pid = fork();
-	switch (pid) {
-	case -1: return -1;
-	case  0:
-		setenv("CLASSPATH", "/system/framework/am.jar", 1);
-		execlp("app_process", "app_process",
-				"/system/bin/",
-				"com.android.commands.am.Am",
-				"broadcast", "-a",
-				ares->intent,
-				len ? "-e" : NULL,
-				len ? "notice" : NULL,
-				len ? buf : NULL,
-				NULL);
-		LOGE("failed to launch am with intent \"%s\"\n", ares->intent);
-		_exit(1);
-	default:
-		waitpid(pid, NULL, 0);
-		break;
-	}
-	return 0;
+	return intent_send(ares->intent, len ? buf : NULL);
 }
 
 static void resource_intent_close(struct resource *res)
@@ -913,6 +1166,7 @@ struct resource *resource_intent_open(const char *name, const char *intent)
 	if (res == NULL)
 		return NULL;
 
+	res->resource.prepare = resource_intent_prepare;
 	res->resource.close = resource_intent_close;
 	res->resource.write_value = resource_intent_write_value;
 
@@ -936,17 +1190,18 @@ static void resource_cpufreq_enable(struct resource *res)
 {
 	struct cpufreq_resource *sres =
 			container_of(res, struct cpufreq_resource, resource);
-	sres->ticket = watch_manager_add_timeout(5000);
+	if (sres->ticket == NULL)
+		sres->ticket = watch_manager_add_timeout(5000);
+	else if (sres->ticket != NULL && watch_ticket_is_null(sres->ticket))
+		watch_ticket_set_timeout(sres->ticket, 5000);
 }
 
 static void resource_cpufreq_disable(struct resource *res)
 {
 	struct cpufreq_resource *sres =
 			container_of(res, struct cpufreq_resource, resource);
-	if (sres->ticket != NULL) {
-		watch_ticket_delete(sres->ticket);
-		sres->ticket = NULL;
-	}
+	if (sres->ticket != NULL)
+		watch_ticket_set_null(sres->ticket);
 }
 
 static void resource_cpufreq_close(struct resource *res)
@@ -995,6 +1250,55 @@ static int resource_cpufreq_write_value(struct resource *res,
 	return len;
 }
 
+static int resource_cpufreq_read_int(struct resource *res, int *value)
+{
+	struct cpufreq_resource *sres =
+			container_of(res, struct cpufreq_resource, resource);
+	unsigned int cur;
+
+	if (cpufreq_read_cur(sres->cpufreq, &cur))
+		return -1;
+	*value = cur;
+	return 0;
+}
+
+static int resource_cpufreq_write_int(struct resource *res, int value)
+{
+	struct cpufreq_resource *sres =
+			container_of(res, struct cpufreq_resource, resource);
+	return cpufreq_write_max(sres->cpufreq, value);
+}
+
+static int resource_cpufreq_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct cpufreq_resource *sres =
+			container_of(res, struct cpufreq_resource, resource);
+	unsigned int freq;
+	int rc;
+
+	switch (unit) {
+	case RESOURCE_UNIT_ABSOLUTE:
+		freq = cpufreq_snap(sres->cpufreq, value);
+		rc = 0;
+		break;
+	case RESOURCE_UNIT_PERCENT:
+		rc = cpufreq_resolve_percent(sres->cpufreq, value, &freq);
+		break;
+	case RESOURCE_UNIT_INDEX:
+		rc = cpufreq_resolve_index(sres->cpufreq, value, &freq);
+		break;
+	default:
+		rc = -1;
+		break;
+	}
+	if (rc)
+		return -1;
+
+	*out = freq;
+	return 0;
+}
+
 struct resource *resource_cpufreq_open(const char *name, const char *file)
 {
 	struct cpufreq_resource *res;
@@ -1009,9 +1313,12 @@ struct resource *resource_cpufreq_open(const char *name, const char *file)
 		return NULL;
 	}
 	res->resource.write_value = resource_cpufreq_write_value;
+	res->resource.resolve_value = resource_cpufreq_resolve_value;
 	res->resource.enable = resource_cpufreq_enable;
 	res->resource.disable = resource_cpufreq_disable;
 	res->resource.read_value = resource_cpufreq_read_value;
+	res->resource.read_int = resource_cpufreq_read_int;
+	res->resource.write_int = resource_cpufreq_write_int;
 	res->resource.close = resource_cpufreq_close;
 
 	strncpy(res->resource.name, name, sizeof(res->resource.name));
@@ -1020,3 +1327,1388 @@ struct resource *resource_cpufreq_open(const char *name, const char *file)
 	return &res->resource;
 }
 
+
+struct devfreq_resource {
+	struct resource resource;
+	struct watch_ticket *ticket;
+	struct devfreq *devfreq;
+};
+
+static void resource_devfreq_enable(struct resource *res)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+	if (dres->ticket == NULL)
+		dres->ticket = watch_manager_add_timeout(5000);
+	else if (dres->ticket != NULL && watch_ticket_is_null(dres->ticket))
+		watch_ticket_set_timeout(dres->ticket, 5000);
+}
+
+static void resource_devfreq_disable(struct resource *res)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+	if (dres->ticket != NULL)
+		watch_ticket_set_null(dres->ticket);
+}
+
+static void resource_devfreq_close(struct resource *res)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+
+	if (dres->ticket != NULL)
+		watch_ticket_delete(dres->ticket);
+	devfreq_close(dres->devfreq);
+	free(dres);
+}
+
+static int resource_devfreq_read_int(struct resource *res, int *value)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+	unsigned long cur;
+
+	if (devfreq_read_cur(dres->devfreq, &cur))
+		return -1;
+	*value = cur / 1000;
+	return 0;
+}
+
+static int resource_devfreq_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_devfreq_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+/*
+ * devfreq works in Hz, which overflows an int above 2.1 GHz, so values are
+ * exchanged in kHz like cpufreq values.
+ */
+static int resource_devfreq_khz_to_hz(long khz, unsigned long *hz)
+{
+	if (khz < 0 || (unsigned long)khz > ULONG_MAX / 1000)
+		return -1;
+	*hz = (unsigned long)khz * 1000;
+	return 0;
+}
+
+static int resource_devfreq_write_int(struct resource *res, int value)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+	unsigned long hz;
+
+	if (resource_devfreq_khz_to_hz(value, &hz)) {
+		LOGW("%s: %d kHz out of range\n", res->name, value);
+		return -1;
+	}
+	return devfreq_write_max(dres->devfreq, hz);
+}
+
+static int resource_devfreq_write_value(struct resource *res,
+		const char *val, unsigned int len)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+	unsigned long hz;
+	char buf[32];
+
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, val, len);
+	buf[len] = 0;
+	if (resource_devfreq_khz_to_hz(strtol(buf, 0, 0), &hz)) {
+		LOGW("%s: %s kHz out of range\n", res->name, buf);
+		return -1;
+	}
+	if (devfreq_write_max(dres->devfreq, hz))
+		return -1;
+	return len;
+}
+
+static int resource_devfreq_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct devfreq_resource *dres =
+			container_of(res, struct devfreq_resource, resource);
+	unsigned long freq;
+	int rc;
+
+	switch (unit) {
+	case RESOURCE_UNIT_ABSOLUTE:
+		rc = resource_devfreq_khz_to_hz(value, &freq);
+		if (rc == 0)
+			freq = devfreq_snap(dres->devfreq, freq);
+		break;
+	case RESOURCE_UNIT_PERCENT:
+		rc = devfreq_resolve_percent(dres->devfreq, value, &freq);
+		break;
+	case RESOURCE_UNIT_INDEX:
+		rc = devfreq_resolve_index(dres->devfreq, value, &freq);
+		break;
+	default:
+		rc = -1;
+		break;
+	}
+	if (rc)
+		return -1;
+
+	*out = freq / 1000;
+	return 0;
+}
+
+struct resource *resource_devfreq_open(const char *name, const char *file)
+{
+	struct devfreq_resource *res;
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	res->devfreq = devfreq_open(file);
+	if (res->devfreq == NULL) {
+		free(res);
+		return NULL;
+	}
+	res->resource.write_value = resource_devfreq_write_value;
+	res->resource.write_int = resource_devfreq_write_int;
+	res->resource.read_value = resource_devfreq_read_value;
+	res->resource.read_int = resource_devfreq_read_int;
+	res->resource.resolve_value = resource_devfreq_resolve_value;
+	res->resource.enable = resource_devfreq_enable;
+	res->resource.disable = resource_devfreq_disable;
+	res->resource.close = resource_devfreq_close;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+struct cooling_resource {
+	struct resource resource;
+	int cur_state_fd;
+	int max_state;
+	int cur_state;
+	unsigned int cur_state_tick;
+};
+
+static void resource_cooling_close(struct resource *res)
+{
+	struct cooling_resource *cres =
+			container_of(res, struct cooling_resource, resource);
+	close(cres->cur_state_fd);
+	free(cres);
+}
+
+static int resource_cooling_read_int(struct resource *res, int *value)
+{
+	struct cooling_resource *cres =
+			container_of(res, struct cooling_resource, resource);
+	char buf[13];
+	int rc;
+
+	rc = pread(cres->cur_state_fd, buf, sizeof(buf) - 1, 0);
+	if (rc <= 0)
+		return -1;
+	buf[rc] = 0;
+	*value = strtol(buf, 0, 0);
+	return 0;
+}
+
+static int resource_cooling_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_cooling_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+static int resource_cooling_write_int(struct resource *res, int value)
+{
+	struct cooling_resource *cres =
+			container_of(res, struct cooling_resource, resource);
+	unsigned int tick = resource_write_tick();
+	char buf[13];
+	int rc;
+
+	if (value < 0)
+		value = 0;
+	if (value > cres->max_state)
+		value = cres->max_state;
+	/* a thermal zone bound to the device may have changed cur_state */
+	if (value == cres->cur_state && tick == cres->cur_state_tick)
+		return 0;
+
+	rc = snprintf(buf, sizeof(buf), "%d", value);
+	rc = pwrite(cres->cur_state_fd, buf, rc, 0);
+	if (rc <= 0) {
+		cres->cur_state = -1;
+		return -1;
+	}
+	cres->cur_state = value;
+	cres->cur_state_tick = tick;
+	return 0;
+}
+
+static int resource_cooling_write_value(struct resource *res,
+		const char *val, unsigned int len)
+{
+	char buf[13];
+
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, val, len);
+	buf[len] = 0;
+	if (resource_cooling_write_int(res, strtol(buf, 0, 0)))
+		return -1;
+	return len;
+}
+
+/*
+ * Percentages are a fraction of max_state, indexes count states from 0 or,
+ * when negative, down from max_state (-1).
+ */
+static int resource_cooling_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct cooling_resource *cres =
+			container_of(res, struct cooling_resource, resource);
+
+	switch (unit) {
+	case RESOURCE_UNIT_ABSOLUTE:
+		break;
+	case RESOURCE_UNIT_PERCENT:
+		value = (cres->max_state * value + 50) / 100;
+		break;
+	case RESOURCE_UNIT_INDEX:
+		if (value < 0)
+			value += cres->max_state + 1;
+		break;
+	default:
+		return -1;
+	}
+
+	if (value < 0)
+		value = 0;
+	if (value > cres->max_state)
+		value = cres->max_state;
+	*out = value;
+	return 0;
+}
+
+struct resource *resource_cooling_open(const char *name, const char *dir)
+{
+	struct cooling_resource *res;
+	char fname[PATH_MAX];
+	char buf[13];
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	snprintf(fname, sizeof(fname), "%s/max_state", dir);
+	if (util_read_file(fname, buf, sizeof(buf)) <= 0) {
+		free(res);
+		return NULL;
+	}
+	res->max_state = strtol(buf, 0, 0);
+	res->cur_state = -1;
+
+	snprintf(fname, sizeof(fname), "%s/cur_state", dir);
+	res->cur_state_fd = open(fname, O_RDWR);
+	if (res->cur_state_fd == -1) {
+		free(res);
+		return NULL;
+	}
+
+	res->resource.close = resource_cooling_close;
+	res->resource.read_value = resource_cooling_read_value;
+	res->resource.read_int = resource_cooling_read_int;
+	res->resource.write_value = resource_cooling_write_value;
+	res->resource.write_int = resource_cooling_write_int;
+	res->resource.resolve_value = resource_cooling_resolve_value;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+#define POWERCAP_MAX_WINDOW 16
+
+/*
+ * Reads average power in uW derived from energy_uj over the last window
+ * samples, and writes power limits in uW to constraint_N_power_limit_uw.
+ */
+struct powercap_resource {
+	struct resource resource;
+	struct watch_ticket *ticket;
+	unsigned int interval;
+	int limit_fd;
+	int energy_fd;
+	int limit;
+	unsigned int limit_tick;
+	int max_power;
+	unsigned long long max_energy;
+	unsigned long long last_energy;
+	unsigned long long total[POWERCAP_MAX_WINDOW];
+	unsigned long long time_us[POWERCAP_MAX_WINDOW];
+	int window;
+	int nsamples;
+	int head;
+};
+
+static void resource_powercap_enable(struct resource *res)
+{
+	struct powercap_resource *pres =
+			container_of(res, struct powercap_resource, resource);
+	if (pres->ticket == NULL)
+		pres->ticket = watch_manager_add_timeout(pres->interval);
+	else if (pres->ticket != NULL && watch_ticket_is_null(pres->ticket))
+		watch_ticket_set_timeout(pres->ticket, pres->interval);
+}
+
+static void resource_powercap_disable(struct resource *res)
+{
+	struct powercap_resource *pres =
+			container_of(res, struct powercap_resource, resource);
+	if (pres->ticket != NULL)
+		watch_ticket_set_null(pres->ticket);
+}
+
+static void resource_powercap_close(struct resource *res)
+{
+	struct powercap_resource *pres =
+			container_of(res, struct powercap_resource, resource);
+
+	if (pres->ticket != NULL)
+		watch_ticket_delete(pres->ticket);
+	if (pres->limit_fd != -1)
+		close(pres->limit_fd);
+	if (pres->energy_fd != -1)
+		close(pres->energy_fd);
+	free(pres);
+}
+
+static int resource_powercap_read_int(struct resource *res, int *value)
+{
+	struct powercap_resource *pres =
+			container_of(res, struct powercap_resource, resource);
+	unsigned long long energy, delta, now;
+	char buf[32];
+	int oldest;
+	int prev;
+	int rc;
+
+	rc = read(pres->energy_fd, buf, sizeof(buf) - 1);
+	lseek(pres->energy_fd, 0, SEEK_SET);
+	if (rc <= 0)
+		return -1;
+	buf[rc] = 0;
+	energy = strtoull(buf, 0, 0);
+
+	now = util_time_us();
+
+	if (pres->nsamples == 0) {
+		delta = 0;
+	} else if (energy >= pres->last_energy) {
+		delta = energy - pres->last_energy;
+	} else if (pres->max_energy >= pres->last_energy) {
+		/* wrapped, the counter runs from 0 to max_energy */
+		delta = pres->max_energy - pres->last_energy + energy + 1;
+	} else {
+		delta = 0;
+	}
+	pres->last_energy = energy;
+
+	prev = pres->head;
+	pres->head = (pres->head + 1) % pres->window;
+	pres->total[pres->head] = pres->total[prev] + delta;
+	pres->time_us[pres->head] = now;
+	if (pres->nsamples < pres->window)
+		pres->nsamples++;
+
+	oldest = (pres->head + pres->window - pres->nsamples + 1) % pres->window;
+	if (pres->nsamples < 2 || now <= pres->time_us[oldest]) {
+		*value = 0;
+		return 0;
+	}
+
+	*value = (pres->total[pres->head] - pres->total[oldest]) * 1000000 /
+			(now - pres->time_us[oldest]);
+	return 0;
+}
+
+static int resource_powercap_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_powercap_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+static int resource_powercap_write_int(struct resource *res, int value)
+{
+	struct powercap_resource *pres =
+			container_of(res, struct powercap_resource, resource);
+	unsigned int tick = resource_write_tick();
+	char buf[13];
+	int rc;
+
+	/* firmware or another service may have changed the limit since */
+	if (value == pres->limit && tick == pres->limit_tick)
+		return 0;
+
+	rc = snprintf(buf, sizeof(buf), "%d", value);
+	rc = pwrite(pres->limit_fd, buf, rc, 0);
+	if (rc <= 0) {
+		pres->limit = -1;
+		return -1;
+	}
+	pres->limit = value;
+	pres->limit_tick = tick;
+	return 0;
+}
+
+static int resource_powercap_write_value(struct resource *res,
+		const char *val, unsigned int len)
+{
+	char buf[13];
+
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, val, len);
+	buf[len] = 0;
+	if (resource_powercap_write_int(res, strtol(buf, 0, 0)))
+		return -1;
+	return len;
+}
+
+static int resource_powercap_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct powercap_resource *pres =
+			container_of(res, struct powercap_resource, resource);
+
+	switch (unit) {
+	case RESOURCE_UNIT_ABSOLUTE:
+		*out = value;
+		return 0;
+	case RESOURCE_UNIT_PERCENT:
+		if (pres->max_power <= 0)
+			return -1;
+		*out = (long long)pres->max_power * value / 100;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static int powercap_open_file(const char *dir, const char *file, int mode)
+{
+	char fname[PATH_MAX];
+	snprintf(fname, sizeof(fname), "%s/%s", dir, file);
+	return open(fname, mode);
+}
+
+static int powercap_read_file(const char *dir, const char *file,
+		char *buf, unsigned int len)
+{
+	char fname[PATH_MAX];
+	snprintf(fname, sizeof(fname), "%s/%s", dir, file);
+	return util_read_file(fname, buf, len);
+}
+
+struct resource *resource_powercap_open(const char *name, const char *dir,
+		int constraint, int window, unsigned int interval)
+{
+	struct powercap_resource *res;
+	char file[64];
+	char buf[32];
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	snprintf(file, sizeof(file), "constraint_%d_power_limit_uw", constraint);
+	res->limit_fd = powercap_open_file(dir, file, O_RDWR);
+	res->energy_fd = powercap_open_file(dir, "energy_uj", O_RDONLY);
+	if (res->limit_fd == -1 && res->energy_fd == -1) {
+		free(res);
+		return NULL;
+	}
+
+	if (res->limit_fd != -1) {
+		res->resource.write_value = resource_powercap_write_value;
+		res->resource.write_int = resource_powercap_write_int;
+		res->resource.resolve_value = resource_powercap_resolve_value;
+		snprintf(file, sizeof(file), "constraint_%d_max_power_uw",
+				constraint);
+		if (powercap_read_file(dir, file, buf, sizeof(buf)) > 0)
+			res->max_power = strtol(buf, 0, 0);
+	}
+	if (res->energy_fd != -1) {
+		res->resource.read_value = resource_powercap_read_value;
+		res->resource.read_int = resource_powercap_read_int;
+		res->resource.enable = resource_powercap_enable;
+		res->resource.disable = resource_powercap_disable;
+		if (powercap_read_file(dir, "max_energy_range_uj",
+				buf, sizeof(buf)) > 0)
+			res->max_energy = strtoull(buf, 0, 0);
+	}
+
+	if (window < 2)
+		window = 2;
+	if (window > POWERCAP_MAX_WINDOW)
+		window = POWERCAP_MAX_WINDOW;
+	res->window = window;
+	res->interval = interval;
+	res->limit = -1;
+	res->resource.close = resource_powercap_close;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+/*
+ * Writes a cgroup v2 interface file such as cpu.max, cpu.uclamp.max or
+ * cpuset.cpus.  A bare number written to cpu.max is taken as the quota
+ * for the configured period.
+ */
+struct cgroup_resource {
+	struct resource resource;
+	int fd;
+	int cpu_max;
+	unsigned int period;
+	char last[256];
+};
+
+static void resource_cgroup_close(struct resource *res)
+{
+	struct cgroup_resource *cres =
+			container_of(res, struct cgroup_resource, resource);
+	close(cres->fd);
+	free(cres);
+}
+
+static int resource_cgroup_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	struct cgroup_resource *cres =
+			container_of(res, struct cgroup_resource, resource);
+	return pread(cres->fd, buf, len, 0);
+}
+
+static int resource_cgroup_write_value(struct resource *res,
+		const char *val, unsigned int len)
+{
+	struct cgroup_resource *cres =
+			container_of(res, struct cgroup_resource, resource);
+	char buf[sizeof(cres->last)];
+	char *end;
+	int rc;
+
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, val, len);
+	buf[len] = 0;
+
+	if (cres->cpu_max) {
+		strtoul(buf, &end, 10);
+		if (end != buf && *end == 0)
+			len = snprintf(buf + len, sizeof(buf) - len, " %u",
+					cres->period) + len;
+	}
+
+	if (!strcmp(buf, cres->last))
+		return len;
+
+	rc = pwrite(cres->fd, buf, len, 0);
+	if (rc <= 0) {
+		cres->last[0] = 0;
+		LOGW("%s: failed to write \"%s\"\n", res->name, buf);
+		return -1;
+	}
+	memcpy(cres->last, buf, len + 1);
+	return len;
+}
+
+/* percentages of cpu.max are relative to one cpu */
+static int resource_cgroup_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct cgroup_resource *cres =
+			container_of(res, struct cgroup_resource, resource);
+
+	switch (unit) {
+	case RESOURCE_UNIT_ABSOLUTE:
+		*out = value;
+		return 0;
+	case RESOURCE_UNIT_PERCENT:
+		if (cres->cpu_max)
+			*out = (long long)cres->period * value / 100;
+		else
+			*out = value;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+struct resource *resource_cgroup_open(const char *name, const char *dir,
+		const char *file, unsigned int period)
+{
+	struct cgroup_resource *res;
+	char fname[PATH_MAX];
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	snprintf(fname, sizeof(fname), "%s/%s", dir, file);
+	res->fd = open(fname, O_RDWR);
+	if (res->fd == -1) {
+		free(res);
+		return NULL;
+	}
+	res->cpu_max = !strcmp(file, "cpu.max");
+	res->period = period;
+
+	res->resource.close = resource_cgroup_close;
+	res->resource.read_value = resource_cgroup_read_value;
+	res->resource.write_value = resource_cgroup_write_value;
+	res->resource.resolve_value = resource_cgroup_resolve_value;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+struct hotplug_resource {
+	struct resource resource;
+	struct hotplug *hotplug;
+};
+
+static void resource_hotplug_close(struct resource *res)
+{
+	struct hotplug_resource *hres =
+			container_of(res, struct hotplug_resource, resource);
+	hotplug_close(hres->hotplug);
+	free(hres);
+}
+
+static int resource_hotplug_read_int(struct resource *res, int *value)
+{
+	struct hotplug_resource *hres =
+			container_of(res, struct hotplug_resource, resource);
+	*value = hotplug_parked(hres->hotplug);
+	return 0;
+}
+
+static int resource_hotplug_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_hotplug_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+static int resource_hotplug_write_int(struct resource *res, int value)
+{
+	struct hotplug_resource *hres =
+			container_of(res, struct hotplug_resource, resource);
+	return hotplug_park(hres->hotplug, (unsigned int)value);
+}
+
+static int resource_hotplug_write_value(struct resource *res,
+		const char *val, unsigned int len)
+{
+	char buf[32];
+
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, val, len);
+	buf[len] = 0;
+	if (resource_hotplug_write_int(res, strtoul(buf, 0, 0)))
+		return -1;
+	return len;
+}
+
+struct resource *resource_hotplug_open(const char *name, const char *cpus)
+{
+	struct hotplug_resource *res;
+	unsigned long mask;
+
+	if (util_parse_cpulist(cpus, &mask) || mask == 0)
+		return NULL;
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	res->hotplug = hotplug_open(mask);
+	if (res->hotplug == NULL) {
+		free(res);
+		return NULL;
+	}
+
+	res->resource.close = resource_hotplug_close;
+	res->resource.read_value = resource_hotplug_read_value;
+	res->resource.read_int = resource_hotplug_read_int;
+	res->resource.write_value = resource_hotplug_write_value;
+	res->resource.write_int = resource_hotplug_write_int;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+#define PREDICT_MAX_SAMPLES 32
+
+/*
+ * Reports the value of another resource extrapolated horizon ms ahead,
+ * using the least-squares slope over the last samples.  Samples are only
+ * stored when the interval ticket fired, so reads on unrelated wakes of
+ * the main loop do not crowd out the history; they are extrapolated with
+ * the slope of the stored samples.
+ */
+struct predict_resource {
+	struct resource resource;
+	struct resource *aliased;
+	char alias_name[256];
+	struct watch_ticket *ticket;
+	unsigned int interval;
+	int horizon;
+	int nsamples;
+	int size;
+	int head;
+	unsigned long long time[PREDICT_MAX_SAMPLES];
+	int value[PREDICT_MAX_SAMPLES];
+};
+
+static int resource_predict_prepare(struct resource *res)
+{
+	struct predict_resource *pres =
+			container_of(res, struct predict_resource, resource);
+	pres->aliased = resource_manager_find(pres->alias_name);
+	return -(pres->aliased == NULL);
+}
+
+static void resource_predict_set_edges(struct resource *res, int lo, int hi)
+{
+	struct predict_resource *pres =
+			container_of(res, struct predict_resource, resource);
+	resource_set_edges(pres->aliased, lo, hi);
+}
+
+static void resource_predict_enable(struct resource *res)
+{
+	struct predict_resource *pres =
+			container_of(res, struct predict_resource, resource);
+	if (pres->ticket == NULL)
+		pres->ticket = watch_manager_add_timeout(pres->interval);
+	else if (pres->ticket != NULL && watch_ticket_is_null(pres->ticket))
+		watch_ticket_set_timeout(pres->ticket, pres->interval);
+	resource_enable(pres->aliased);
+}
+
+static void resource_predict_disable(struct resource *res)
+{
+	struct predict_resource *pres =
+			container_of(res, struct predict_resource, resource);
+	if (pres->ticket != NULL)
+		watch_ticket_set_null(pres->ticket);
+	resource_disable(pres->aliased);
+}
+
+static void resource_predict_close(struct resource *res)
+{
+	struct predict_resource *pres =
+			container_of(res, struct predict_resource, resource);
+	if (pres->ticket != NULL)
+		watch_ticket_delete(pres->ticket);
+	free(pres);
+}
+
+static int resource_predict_read_int(struct resource *res, int *out)
+{
+	struct predict_resource *pres =
+			container_of(res, struct predict_resource, resource);
+	long long st, sv, stt, stv, t, num, den;
+	unsigned long long now;
+	int value;
+	int i, idx;
+
+	if (resource_sample(pres->aliased, &value))
+		return -1;
+	now = util_time_ms();
+
+	if (pres->nsamples == 0 || pres->ticket == NULL ||
+			watch_ticket_clear(pres->ticket) == 0) {
+		/* several samples within one ms only refresh the newest */
+		if (pres->nsamples == 0 || now != pres->time[pres->head]) {
+			pres->head = (pres->head + 1) % pres->size;
+			if (pres->nsamples < pres->size)
+				pres->nsamples++;
+		}
+		pres->time[pres->head] = now;
+		pres->value[pres->head] = value;
+	}
+
+	*out = value;
+	if (pres->nsamples < 2)
+		return 0;
+
+	st = sv = stt = stv = 0;
+	for (i = 0; i < pres->nsamples; ++i) {
+		idx = (pres->head + pres->size - i) % pres->size;
+		t = (long long)(pres->time[idx] - now);
+		st += t;
+		sv += pres->value[idx];
+		stt += t * t;
+		stv += t * pres->value[idx];
+	}
+	num = pres->nsamples * stv - st * sv;
+	den = pres->nsamples * stt - st * st;
+	if (den != 0)
+		*out = value + num * pres->horizon / den;
+	return 0;
+}
+
+static int resource_predict_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_predict_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+struct resource *resource_predict_open(const char *name, const char *resource,
+		int horizon, int samples, unsigned int interval)
+{
+	struct predict_resource *res;
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	if (samples < 2)
+		samples = 2;
+	if (samples > PREDICT_MAX_SAMPLES)
+		samples = PREDICT_MAX_SAMPLES;
+	res->size = samples;
+	res->horizon = horizon;
+	res->interval = interval;
+
+	res->resource.prepare = resource_predict_prepare;
+	res->resource.enable = resource_predict_enable;
+	res->resource.disable = resource_predict_disable;
+	res->resource.set_edges = resource_predict_set_edges;
+	res->resource.close = resource_predict_close;
+	res->resource.read_value = resource_predict_read_value;
+	res->resource.read_int = resource_predict_read_int;
+	strncpy(res->alias_name, resource, sizeof(res->alias_name));
+	res->alias_name[sizeof(res->alias_name) - 1] = 0;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+#define FILTER_MAX_SIZE 15
+#define FILTER_KALMAN_ONE 65536
+
+/*
+ * Smooths the value of another resource:
+ *
+ *   ewma:   y += alpha * (x - y), alpha in RESOURCE_FILTER_ALPHA_ONE units
+ *   median: median of the last size samples
+ *   kalman: scalar Kalman filter for a constant value with process noise
+ *           q and measurement noise r, in squared value units
+ *
+ * Edges are remembered so that crossings of the raw value which the
+ * filtered value did not follow can be counted as avoided transitions.
+ * Each one is also recorded, so the count can be followed at runtime.
+ */
+struct filter_resource {
+	struct resource resource;
+	struct resource *aliased;
+	char alias_name[256];
+	enum resource_filter_type type;
+	struct watch_ticket *ticket;
+	unsigned int interval;
+	int started;
+	int value;
+	long long p;
+	long long q;
+	long long r;
+	int alpha;
+	int size;
+	int count;
+	int head;
+	int history[FILTER_MAX_SIZE];
+	int lo;
+	int hi;
+	int raw;
+	int raw_region;
+	unsigned int avoided;
+};
+
+static int resource_filter_prepare(struct resource *res)
+{
+	struct filter_resource *fres =
+			container_of(res, struct filter_resource, resource);
+	fres->aliased = resource_manager_find(fres->alias_name);
+	return -(fres->aliased == NULL);
+}
+
+static int resource_filter_region(struct filter_resource *fres, int value)
+{
+	if (value >= fres->hi)
+		return 1;
+	if (value <= fres->lo)
+		return -1;
+	return 0;
+}
+
+static void resource_filter_set_edges(struct resource *res, int lo, int hi)
+{
+	struct filter_resource *fres =
+			container_of(res, struct filter_resource, resource);
+	if (fres->lo != lo || fres->hi != hi) {
+		fres->lo = lo;
+		fres->hi = hi;
+		/* moving the edges is not a crossing of the raw value */
+		fres->raw_region = fres->started ?
+				resource_filter_region(fres, fres->raw) : 0;
+	}
+	resource_set_edges(fres->aliased, lo, hi);
+}
+
+static void resource_filter_enable(struct resource *res)
+{
+	struct filter_resource *fres =
+			container_of(res, struct filter_resource, resource);
+	if (fres->ticket == NULL && fres->interval)
+		fres->ticket = watch_manager_add_timeout(fres->interval);
+	else if (fres->ticket != NULL && watch_ticket_is_null(fres->ticket))
+		watch_ticket_set_timeout(fres->ticket, fres->interval);
+	resource_enable(fres->aliased);
+}
+
+static void resource_filter_disable(struct resource *res)
+{
+	struct filter_resource *fres =
+			container_of(res, struct filter_resource, resource);
+	if (fres->ticket != NULL)
+		watch_ticket_set_null(fres->ticket);
+	resource_disable(fres->aliased);
+}
+
+static void resource_filter_close(struct resource *res)
+{
+	struct filter_resource *fres =
+			container_of(res, struct filter_resource, resource);
+	if (fres->avoided)
+		LOGI("%s: %u transitions avoided\n", res->name, fres->avoided);
+	if (fres->ticket != NULL)
+		watch_ticket_delete(fres->ticket);
+	free(fres);
+}
+
+static int resource_filter_median(struct filter_resource *fres, int raw)
+{
+	int sorted[FILTER_MAX_SIZE];
+	int i, j, v;
+
+	fres->history[fres->head] = raw;
+	fres->head = (fres->head + 1) % fres->size;
+	if (fres->count < fres->size)
+		fres->count++;
+
+	for (i = 0; i < fres->count; ++i) {
+		v = fres->history[i];
+		for (j = i; j > 0 && sorted[j - 1] > v; --j)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = v;
+	}
+	return sorted[fres->count / 2];
+}
+
+static int resource_filter_kalman(struct filter_resource *fres, int raw)
+{
+	long long k;
+
+	fres->p += fres->q;
+	k = fres->p * FILTER_KALMAN_ONE / (fres->p + fres->r);
+	fres->p = fres->p * (FILTER_KALMAN_ONE - k) / FILTER_KALMAN_ONE;
+	return fres->value + k * (raw - fres->value) / FILTER_KALMAN_ONE;
+}
+
+static int resource_filter_read_int(struct resource *res, int *value)
+{
+	struct filter_resource *fres =
+			container_of(res, struct filter_resource, resource);
+	int region;
+	int raw;
+
+	/* keep the filtered value through a failed read once started */
+	if (resource_sample(fres->aliased, &raw)) {
+		if (!fres->started)
+			return -1;
+		*value = fres->value;
+		return 0;
+	}
+
+	if (!fres->started) {
+		fres->value = raw;
+		fres->p = fres->r;
+		fres->started = 1;
+	}
+
+	switch (fres->type) {
+	case RESOURCE_FILTER_EWMA:
+		fres->value += (long long)fres->alpha * (raw - fres->value) /
+				RESOURCE_FILTER_ALPHA_ONE;
+		break;
+	case RESOURCE_FILTER_MEDIAN:
+		fres->value = resource_filter_median(fres, raw);
+		break;
+	case RESOURCE_FILTER_KALMAN:
+		fres->value = resource_filter_kalman(fres, raw);
+		break;
+	}
+
+	fres->raw = raw;
+	region = resource_filter_region(fres, raw);
+	if (region != fres->raw_region) {
+		if (region != 0 &&
+				resource_filter_region(fres, fres->value) == 0) {
+			fres->avoided++;
+			LOGV("%s: raw %d crossed an edge, filtered %d did not"
+					" (%u avoided)\n", res->name, raw,
+					fres->value, fres->avoided);
+			recorder_avoided(res, fres->avoided, raw);
+		}
+		fres->raw_region = region;
+	}
+
+	*value = fres->value;
+	return 0;
+}
+
+static int resource_filter_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_filter_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+/*
+ * param1 and param2 are alpha for ewma, size for median and q and r for
+ * kalman.
+ */
+struct resource *resource_filter_open(const char *name, const char *resource,
+		enum resource_filter_type type, int param1, int param2,
+		unsigned int interval)
+{
+	struct filter_resource *res;
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	res->type = type;
+	res->interval = interval;
+	res->lo = INT_MIN;
+	res->hi = INT_MAX;
+	switch (type) {
+	case RESOURCE_FILTER_EWMA:
+		if (param1 <= 0 || param1 > RESOURCE_FILTER_ALPHA_ONE)
+			param1 = RESOURCE_FILTER_ALPHA_ONE;
+		res->alpha = param1;
+		break;
+	case RESOURCE_FILTER_MEDIAN:
+		if (param1 < 1)
+			param1 = 1;
+		if (param1 > FILTER_MAX_SIZE)
+			param1 = FILTER_MAX_SIZE;
+		res->size = param1;
+		break;
+	case RESOURCE_FILTER_KALMAN:
+		res->q = param1 > 0 ? param1 : 1;
+		res->r = param2 > 0 ? param2 : 1;
+		break;
+	}
+
+	res->resource.prepare = resource_filter_prepare;
+	res->resource.enable = resource_filter_enable;
+	res->resource.disable = resource_filter_disable;
+	res->resource.set_edges = resource_filter_set_edges;
+	res->resource.close = resource_filter_close;
+	res->resource.read_value = resource_filter_read_value;
+	res->resource.read_int = resource_filter_read_int;
+	strncpy(res->alias_name, resource, sizeof(res->alias_name));
+	res->alias_name[sizeof(res->alias_name) - 1] = 0;
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+}
+
+/*
+ * Combines member resources into one virtual sensor.  A fusion is one
+ * fixed op with integer weights and an offset, so a read is a single pass
+ * over the member values sampled in the current tick:
+ *
+ *   max, min: extreme member value + offset
+ *   avg:      sum(w * v) / sum(w) + offset
+ *   wsum:     sum(w * v) / RESOURCE_FUSION_WEIGHT_ONE + offset
+ *
+ * Like a union, max, min and avg skip members that fail to read, avg only
+ * over the weights of the members read.  wsum fails when a weighted member
+ * does, and any op fails when no member could be read.
+ */
+struct fusion_resource {
+	struct resource resource;
+	enum resource_fusion_op op;
+	struct resource **members;
+	char **member_names;
+	int *weights;
+	int nmembers;
+	long long divisor;
+	int offset;
+	unsigned int interval;
+	struct watch_ticket *ticket;
+};
+
+static int resource_fusion_prepare(struct resource *res)
+{
+	struct fusion_resource *fres =
+			container_of(res, struct fusion_resource, resource);
+	int i;
+
+	fres->members = calloc(fres->nmembers, sizeof(fres->members[0]));
+	if (fres->members == NULL)
+		return -1;
+
+	for (i = 0; i < fres->nmembers; ++i) {
+		fres->members[i] = resource_manager_find(fres->member_names[i]);
+		if (fres->members[i] == NULL) {
+			LOGE("%s: no member resource \"%s\"\n", res->name,
+					fres->member_names[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int resource_fusion_read_int(struct resource *res, int *out)
+{
+	struct fusion_resource *fres =
+			container_of(res, struct fusion_resource, resource);
+	long long divisor;
+	long long acc;
+	int value;
+	int valid;
+	int i;
+
+	valid = 0;
+	acc = 0;
+	divisor = 0;
+	for (i = 0; i < fres->nmembers; ++i) {
+		if (resource_sample(fres->members[i], &value)) {
+			if (fres->op == RESOURCE_FUSION_WSUM &&
+					fres->weights[i] != 0)
+				return -1;
+			continue;
+		}
+
+		switch (fres->op) {
+		case RESOURCE_FUSION_MAX:
+			if (!valid || value > acc)
+				acc = value;
+			break;
+		case RESOURCE_FUSION_MIN:
+			if (!valid || value < acc)
+				acc = value;
+			break;
+		default:
+			acc += (long long)fres->weights[i] * value;
+			divisor += fres->weights[i];
+			break;
+		}
+		valid = 1;
+	}
+
+	if (!valid)
+		return -1;
+	if (fres->op == RESOURCE_FUSION_AVG) {
+		if (divisor == 0)
+			return -1;
+		acc /= divisor;
+	} else if (fres->divisor) {
+		acc /= fres->divisor;
+	}
+	*out = acc + fres->offset;
+	return 0;
+}
+
+static int resource_fusion_read_value(struct resource *res,
+		char *buf, unsigned int len)
+{
+	int value;
+
+	if (resource_fusion_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+/*
+ * The max or min of the members only crosses an edge when one of the
+ * members crosses it, weighted sums are polled instead.
+ */
+static void resource_fusion_set_edges(struct resource *res, int lo, int hi)
+{
+	struct fusion_resource *fres =
+			container_of(res, struct fusion_resource, resource);
+	int i;
+
+	if (fres->op != RESOURCE_FUSION_MAX && fres->op != RESOURCE_FUSION_MIN)
+		return;
+
+	if (lo != INT_MIN)
+		lo = (long long)lo - fres->offset < INT_MIN ?
+				INT_MIN : lo - fres->offset;
+	if (hi != INT_MAX)
+		hi = (long long)hi - fres->offset > INT_MAX ?
+				INT_MAX : hi - fres->offset;
+
+	for (i = 0; i < fres->nmembers; ++i)
+		resource_set_edges(fres->members[i], lo, hi);
+}
+
+static void resource_fusion_enable(struct resource *res)
+{
+	struct fusion_resource *fres =
+			container_of(res, struct fusion_resource, resource);
+	int i;
+
+	for (i = 0; i < fres->nmembers; ++i)
+		resource_enable(fres->members[i]);
+	if (fres->ticket == NULL && fres->interval)
+		fres->ticket = watch_manager_add_timeout(fres->interval);
+	else if (fres->ticket != NULL && watch_ticket_is_null(fres->ticket))
+		watch_ticket_set_timeout(fres->ticket, fres->interval);
+}
+
+static void resource_fusion_disable(struct resource *res)
+{
+	struct fusion_resource *fres =
+			container_of(res, struct fusion_resource, resource);
+	int i;
+
+	if (fres->ticket != NULL)
+		watch_ticket_set_null(fres->ticket);
+	for (i = 0; i < fres->nmembers; ++i)
+		resource_disable(fres->members[i]);
+}
+
+static void resource_fusion_close(struct resource *res)
+{
+	struct fusion_resource *fres =
+			container_of(res, struct fusion_resource, resource);
+	int i;
+
+	if (fres->ticket != NULL)
+		watch_ticket_delete(fres->ticket);
+	if (fres->member_names != NULL) {
+		for (i = 0; i < fres->nmembers; ++i)
+			free(fres->member_names[i]);
+	}
+	free(fres->member_names);
+	free(fres->members);
+	free(fres->weights);
+	free(fres);
+}
+
+struct resource *resource_fusion_open(const char *name,
+		enum resource_fusion_op op, int count, const char **names,
+		const int *weights, int offset, unsigned int interval)
+{
+	struct fusion_resource *res;
+	int i;
+
+	if (count <= 0)
+		return NULL;
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL)
+		return NULL;
+
+	res->resource.prepare = resource_fusion_prepare;
+	res->resource.enable = resource_fusion_enable;
+	res->resource.disable = resource_fusion_disable;
+	res->resource.set_edges = resource_fusion_set_edges;
+	res->resource.close = resource_fusion_close;
+	res->resource.read_value = resource_fusion_read_value;
+	res->resource.read_int = resource_fusion_read_int;
+	res->op = op;
+	res->offset = offset;
+	res->interval = interval;
+	res->nmembers = count;
+
+	res->member_names = calloc(count, sizeof(res->member_names[0]));
+	res->weights = calloc(count, sizeof(res->weights[0]));
+	if (res->member_names == NULL || res->weights == NULL)
+		goto fail;
+
+	for (i = 0; i < count; ++i) {
+		res->member_names[i] = strdup(names[i]);
+		if (res->member_names[i] == NULL)
+			goto fail;
+		res->weights[i] = weights[i];
+		res->divisor += weights[i];
+	}
+
+	if (op == RESOURCE_FUSION_WSUM)
+		res->divisor = RESOURCE_FUSION_WEIGHT_ONE;
+	else if (op != RESOURCE_FUSION_AVG)
+		res->divisor = 0;
+	if (op == RESOURCE_FUSION_AVG && res->divisor == 0) {
+		LOGE("%s: fusion weights sum to zero\n", name);
+		goto fail;
+	}
+
+	strncpy(res->resource.name, name, sizeof(res->resource.name));
+	res->resource.name[sizeof(res->resource.name) - 1] = 0;
+
+	return &res->resource;
+
+fail:
+	resource_fusion_close(&res->resource);
+	return NULL;
+}
@@ -8,6 +8,31 @@ enum resource_sysfs_t {
 	RESOURCE_SYSFS_RDWR,
 };
 
+enum resource_unit {
+	RESOURCE_UNIT_ABSOLUTE,
+	RESOURCE_UNIT_PERCENT,
+	RESOURCE_UNIT_INDEX,
+};
+
+enum resource_fusion_op {
+	RESOURCE_FUSION_MAX,
+	RESOURCE_FUSION_MIN,
+	RESOURCE_FUSION_AVG,
+	RESOURCE_FUSION_WSUM,
+};
+
+enum resource_filter_type {
+	RESOURCE_FILTER_EWMA,
+	RESOURCE_FILTER_MEDIAN,
+	RESOURCE_FILTER_KALMAN,
+};
+
+/* ewma alpha is fixed point with this scale */
+#define RESOURCE_FILTER_ALPHA_ONE 1024
+
+/* fusion weights are fixed point with this scale */
+#define RESOURCE_FUSION_WEIGHT_ONE 1000
+
 struct resource {
 	char name[256];
 
@@ -19,6 +44,30 @@ struct resource {
 
 	int (* read_value)(struct resource *, char *, unsigned int len);
 	int (* write_value)(struct resource *, const char *, unsigned int len);
+	int (* read_int)(struct resource *, int *value);
+	int (* write_int)(struct resource *, int value);
+	int (* resolve_value)(struct resource *, enum resource_unit unit,
+			int value, int *out);
+
+	/*
+	 * Resources whose value is the content of a file expose its fd, so
+	 * it can be read in a batch with other resources.  read_complete is
+	 * then called with the value read.
+	 */
+	int (* read_fd)(struct resource *);
+	void (* read_complete)(struct resource *, int value);
+
+	/* value sampled during the current tick, see resource_sample() */
+	unsigned int sample_tick;
+	int sample_rc;
+	int sample_value;
+
+	/* bumped on every queued write, see actuator_write_int() */
+	unsigned int write_seq;
+	/* 1 + index of the write staged for this tick, or 0 */
+	int staged;
+	/* name index in the flight recorder, or 0 */
+	unsigned int record_id;
 
 	struct list_node list_node;
 };
@@ -27,12 +76,16 @@ struct resource *resource_manager_find(const char *name);
 void resource_manager_add(struct resource *res);
 void resource_manager_remove(struct resource *res);
 void resource_manager_prepare(void);
+void resource_manager_tick(void);
+int resource_manager_batch_start(void);
 
 struct resource *resource_tz_open(const char *name, const char *file);
 struct resource *resource_sysfs_open(const char *name, const char *file,
 		enum resource_sysfs_t sysfs_type);
 struct resource *resource_union_open(const char *name,
 		int count, const char **children_names);
+int resource_union_members(struct resource *res,
+		struct resource ***members);
 struct resource *resource_alias_open(const char *name, const char *aliased);
 struct resource *resource_halt_open(const char *name, int delay);
 struct resource *resource_echo_open(const char *name);
@@ -41,6 +94,21 @@ struct resource *resource_deadband_open(const char *name,
 struct resource *resource_msmadc_open(const char *name, const char *file);
 struct resource *resource_intent_open(const char *name, const char *intent);
 struct resource *resource_cpufreq_open(const char *name, const char *file);
+struct resource *resource_devfreq_open(const char *name, const char *file);
+struct resource *resource_cooling_open(const char *name, const char *dir);
+struct resource *resource_powercap_open(const char *name, const char *dir,
+		int constraint, int window, unsigned int interval);
+struct resource *resource_cgroup_open(const char *name, const char *dir,
+		const char *file, unsigned int period);
+struct resource *resource_hotplug_open(const char *name, const char *cpus);
+struct resource *resource_predict_open(const char *name, const char *resource,
+		int horizon, int samples, unsigned int interval);
+struct resource *resource_filter_open(const char *name, const char *resource,
+		enum resource_filter_type type, int param1, int param2,
+		unsigned int interval);
+struct resource *resource_fusion_open(const char *name,
+		enum resource_fusion_op op, int count, const char **names,
+		const int *weights, int offset, unsigned int interval);
 
 void resource_close(struct resource *res);
 void resource_set_edges(struct resource *, int lower, int upper);
@@ -50,8 +118,11 @@ void resource_disable(struct resource *res);
 int resource_read_value(struct resource *res, char *buf, unsigned int len);
 int resource_write_value(struct resource *res,
 		const char *val, unsigned int len);
+int resource_resolve_value(struct resource *res, enum resource_unit unit,
+		int value, int *out);
 
-int resource_read_int(struct resource *res);
+int resource_read_int(struct resource *res, int *value);
+int resource_sample(struct resource *res, int *value);
 int resource_write_int(struct resource *res, int value);
 
 #endif
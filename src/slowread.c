@@ -0,0 +1,291 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "list.h"
+#include "util.h"
+#include "slowread.h"
+
+#define SLOWREAD_WORKERS 2
+#define SLOWREAD_BACKOFF_MIN_MS 1000
+#define SLOWREAD_BACKOFF_MAX_MS 30000
+
+/*
+ * Reads of resources marked slow, such as hwmon sensors behind an I2C bus,
+ * are performed by a small pool of worker threads.  The main loop waits
+ * for a read at most deadline ms and otherwise uses the last good value,
+ * which is then flagged as stale.  A sensor that keeps failing or timing
+ * out is backed off exponentially, and a read still stuck in a worker is
+ * never queued a second time.
+ */
+struct slowread {
+	struct resource resource;
+	struct resource *slow;
+	unsigned int deadline;
+
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	int queued;
+	int busy;
+	int rc;
+	int value;
+
+	int valid;
+	int last_good;
+	int stale;
+	unsigned int failures;
+	unsigned long long retry_ms;
+
+	struct list_node list_node;
+};
+
+struct slowread_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	struct list jobs;
+	int started;
+	pthread_t threads[SLOWREAD_WORKERS];
+};
+
+static struct slowread_pool g_slowread_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.jobs = LIST_INIT(jobs),
+};
+
+static void *slowread_worker(void *data)
+{
+	struct slowread_pool *pool = data;
+	struct list_node *node;
+	struct slowread *sr;
+	char buf[32];
+	int value = 0;
+	int rc;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while ((node = list_pop(&pool->jobs)) == NULL)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+
+		sr = list_entry(node, struct slowread, list_node);
+		rc = resource_read_value(sr->slow, buf, sizeof(buf) - 1);
+		if (rc > 0) {
+			buf[rc] = 0;
+			value = strtol(buf, 0, 0);
+		}
+
+		pthread_mutex_lock(&sr->lock);
+		sr->rc = rc;
+		sr->value = value;
+		sr->busy = 0;
+		pthread_cond_signal(&sr->done);
+		pthread_mutex_unlock(&sr->lock);
+	}
+
+	return NULL;
+}
+
+static int slowread_pool_start(struct slowread_pool *pool)
+{
+	int i;
+
+	if (pool->started)
+		return 0;
+
+	for (i = 0; i < SLOWREAD_WORKERS; ++i) {
+		if (pthread_create(&pool->threads[i], NULL,
+				slowread_worker, pool))
+			break;
+		pthread_detach(pool->threads[i]);
+	}
+	if (i == 0) {
+		LOGE("unable to start slow read workers\n");
+		return -1;
+	}
+
+	pool->started = 1;
+	return 0;
+}
+
+static void slowread_failed(struct slowread *sr, unsigned long long now,
+		const char *why)
+{
+	unsigned long long backoff;
+
+	backoff = SLOWREAD_BACKOFF_MIN_MS << (sr->failures < 5 ?
+			sr->failures : 5);
+	if (backoff > SLOWREAD_BACKOFF_MAX_MS)
+		backoff = SLOWREAD_BACKOFF_MAX_MS;
+	sr->failures++;
+	sr->retry_ms = now + backoff;
+
+	if (!sr->stale)
+		LOGW("%s: read %s, using stale value\n", sr->resource.name, why);
+	LOGV("%s: %u failures, retrying in %llu ms\n", sr->resource.name,
+			sr->failures, backoff);
+	sr->stale = 1;
+}
+
+static int slowread_read_int(struct resource *res, int *value)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+	struct slowread_pool *pool = &g_slowread_pool;
+	unsigned long long now;
+	struct timespec ts;
+	int rc = 0;
+
+	now = util_time_ms();
+
+	pthread_mutex_lock(&sr->lock);
+	if (!sr->busy && !sr->queued && now >= sr->retry_ms) {
+		sr->busy = sr->queued = 1;
+		pthread_mutex_lock(&pool->lock);
+		list_append(&pool->jobs, &sr->list_node);
+		pthread_cond_signal(&pool->work);
+		pthread_mutex_unlock(&pool->lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += sr->deadline / 1000;
+		ts.tv_nsec += (sr->deadline % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		while (sr->busy && rc != ETIMEDOUT)
+			rc = pthread_cond_timedwait(&sr->done, &sr->lock, &ts);
+	}
+
+	/* collect a result, possibly from a read that missed its deadline */
+	if (sr->queued && !sr->busy) {
+		sr->queued = 0;
+		if (sr->rc > 0) {
+			if (sr->stale)
+				LOGI("%s: read recovered\n", res->name);
+			sr->last_good = sr->value;
+			sr->valid = 1;
+			sr->stale = 0;
+			sr->failures = 0;
+			sr->retry_ms = 0;
+		} else {
+			slowread_failed(sr, now, "failed");
+		}
+	} else if (sr->queued && rc == ETIMEDOUT) {
+		slowread_failed(sr, now, "timed out");
+	}
+
+	/* nothing to report until the first read succeeded */
+	rc = sr->valid ? 0 : -1;
+	*value = sr->last_good;
+	pthread_mutex_unlock(&sr->lock);
+
+	return rc;
+}
+
+static int slowread_read_value(struct resource *res, char *buf,
+		unsigned int len)
+{
+	int value;
+
+	if (slowread_read_int(res, &value))
+		return -1;
+	return snprintf(buf, len, "%d", value);
+}
+
+static int slowread_prepare(struct resource *res)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+
+	if (resource_prepare(sr->slow))
+		return -1;
+	return slowread_pool_start(&g_slowread_pool);
+}
+
+static void slowread_set_edges(struct resource *res, int lo, int hi)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+	resource_set_edges(sr->slow, lo, hi);
+}
+
+static void slowread_enable(struct resource *res)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+	resource_enable(sr->slow);
+}
+
+static void slowread_disable(struct resource *res)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+	resource_disable(sr->slow);
+}
+
+static int slowread_write_value(struct resource *res, const char *val,
+		unsigned int len)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+	return resource_write_value(sr->slow, val, len);
+}
+
+static int slowread_resolve_value(struct resource *res,
+		enum resource_unit unit, int value, int *out)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+	return resource_resolve_value(sr->slow, unit, value, out);
+}
+
+static void slowread_close(struct resource *res)
+{
+	struct slowread *sr = container_of(res, struct slowread, resource);
+
+	/* a worker may still be stuck reading it, leak rather than race */
+	if (sr->busy) {
+		LOGW("%s: read still pending on close\n", res->name);
+		return;
+	}
+	resource_close(sr->slow);
+	pthread_cond_destroy(&sr->done);
+	pthread_mutex_destroy(&sr->lock);
+	free(sr);
+}
+
+/*
+ * Wraps res, taking over its name, so that its reads go through the
+ * worker pool.  On failure res is left untouched.
+ */
+struct resource *slowread_wrap(struct resource *res, unsigned int deadline)
+{
+	pthread_condattr_t attr;
+	struct slowread *sr;
+
+	sr = calloc(1, sizeof(*sr));
+	if (sr == NULL)
+		return NULL;
+
+	sr->slow = res;
+	sr->deadline = deadline;
+	pthread_mutex_init(&sr->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sr->done, &attr);
+	pthread_condattr_destroy(&attr);
+
+	sr->resource.prepare = slowread_prepare;
+	sr->resource.set_edges = slowread_set_edges;
+	sr->resource.enable = slowread_enable;
+	sr->resource.disable = slowread_disable;
+	sr->resource.close = slowread_close;
+	sr->resource.read_value = slowread_read_value;
+	sr->resource.read_int = slowread_read_int;
+	if (res->write_value != NULL)
+		sr->resource.write_value = slowread_write_value;
+	if (res->resolve_value != NULL)
+		sr->resource.resolve_value = slowread_resolve_value;
+
+	strcpy(sr->resource.name, res->name);
+
+	return &sr->resource;
+}
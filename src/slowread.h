@@ -0,0 +1,8 @@
+#ifndef _SLOWREAD_H_
+#define _SLOWREAD_H_
+
+#include "resource.h"
+
+struct resource *slowread_wrap(struct resource *res, unsigned int deadline);
+
+#endif
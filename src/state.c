@@ -0,0 +1,176 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "util.h"
+#include "control.h"
+#include "configuration.h"
+#include "state.h"
+
+/*
+ * The state page publishes the current level of each control and the last
+ * value and active threshold of each configuration, so other services can
+ * read them with plain loads instead of polling sysfs or asking us.  It is
+ * only written from the main loop, once per tick and only when something
+ * changed.
+ */
+static struct state_header *g_state;
+static struct state_control *g_state_controls;
+static struct state_configuration *g_state_configurations;
+static int g_state_changed;
+
+static void state_count_control(struct control *ctrl, void *data)
+{
+	unsigned int *count = data;
+
+	ctrl->state_idx = (*count)++;
+}
+
+static void state_count_configuration(struct configuration *cfg, void *data)
+{
+	unsigned int *count = data;
+
+	cfg->state_idx = (*count)++;
+}
+
+static void state_name_control(struct control *ctrl,
+		void *data __attribute__ ((__unused__)))
+{
+	struct state_control *sc = &g_state_controls[ctrl->state_idx];
+
+	strncpy(sc->name, ctrl->name, sizeof(sc->name) - 1);
+	sc->level = ctrl->current_level;
+}
+
+static void state_name_configuration(struct configuration *cfg,
+		void *data __attribute__ ((__unused__)))
+{
+	struct state_configuration *sc =
+			&g_state_configurations[cfg->state_idx];
+	unsigned int i;
+
+	strncpy(sc->sensor, cfg->sensor->name, sizeof(sc->sensor) - 1);
+	strncpy(sc->kind, cfg->kind, sizeof(sc->kind) - 1);
+	for (i = 0; i < cfg->state_idx; ++i)
+		if (!strcmp(g_state_configurations[i].sensor, sc->sensor))
+			sc->index++;
+	sc->last_value = cfg->last_value;
+}
+
+int state_start(const char *path)
+{
+	unsigned int ncontrols = 0;
+	unsigned int nconfigurations = 0;
+	unsigned int controls_offset;
+	unsigned int configurations_offset;
+	unsigned int len;
+	void *addr;
+	int fd;
+
+	control_manager_foreach(state_count_control, &ncontrols);
+	configuration_manager_foreach(state_count_configuration,
+			&nconfigurations);
+
+	controls_offset = sizeof(struct state_header);
+	configurations_offset = controls_offset +
+			ncontrols * sizeof(struct state_control);
+	len = configurations_offset +
+			nconfigurations * sizeof(struct state_configuration);
+
+	addr = util_shm_create(path, len, &fd);
+	if (addr == NULL) {
+		LOGE("unable to create state page: %s\n", strerror(errno));
+		return -1;
+	}
+
+	g_state = addr;
+	g_state_controls = (struct state_control *)
+			((char *)addr + controls_offset);
+	g_state_configurations = (struct state_configuration *)
+			((char *)addr + configurations_offset);
+
+	g_state->pid = getpid();
+	g_state->ncontrols = ncontrols;
+	g_state->nconfigurations = nconfigurations;
+	g_state->controls_offset = controls_offset;
+	g_state->configurations_offset = configurations_offset;
+	control_manager_foreach(state_name_control, NULL);
+	configuration_manager_foreach(state_name_configuration, NULL);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(g_state->magic, STATE_MAGIC, sizeof(g_state->magic));
+
+	if (path != NULL)
+		LOGI("publishing state to %s\n", path);
+	else
+		LOGI("publishing state to /proc/%d/fd/%d\n", getpid(), fd);
+
+	return 0;
+}
+
+static void state_check_control(struct control *ctrl,
+		void *data __attribute__ ((__unused__)))
+{
+	if (g_state_controls[ctrl->state_idx].level != ctrl->current_level)
+		g_state_changed = 1;
+}
+
+static void state_check_configuration(struct configuration *cfg,
+		void *data __attribute__ ((__unused__)))
+{
+	struct state_configuration *sc =
+			&g_state_configurations[cfg->state_idx];
+	struct threshold *t = cfg->current;
+
+	if (sc->last_value != cfg->last_value ||
+			sc->active != (t != NULL) ||
+			(t != NULL && (sc->trigger != t->trigger ||
+					sc->clear != t->clear)))
+		g_state_changed = 1;
+}
+
+static void state_write_control(struct control *ctrl,
+		void *data __attribute__ ((__unused__)))
+{
+	struct state_control *sc = &g_state_controls[ctrl->state_idx];
+
+	__atomic_store_n(&sc->level, ctrl->current_level, __ATOMIC_RELAXED);
+}
+
+static void state_write_configuration(struct configuration *cfg,
+		void *data __attribute__ ((__unused__)))
+{
+	struct state_configuration *sc =
+			&g_state_configurations[cfg->state_idx];
+	struct threshold *t = cfg->current;
+
+	__atomic_store_n(&sc->last_value, cfg->last_value, __ATOMIC_RELAXED);
+	__atomic_store_n(&sc->active, t != NULL, __ATOMIC_RELAXED);
+	__atomic_store_n(&sc->trigger, t ? t->trigger : 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&sc->clear, t ? t->clear : 0, __ATOMIC_RELAXED);
+}
+
+void state_publish(void)
+{
+	uint32_t seq;
+
+	if (g_state == NULL)
+		return;
+
+	g_state_changed = 0;
+	control_manager_foreach(state_check_control, NULL);
+	configuration_manager_foreach(state_check_configuration, NULL);
+	if (!g_state_changed)
+		return;
+
+	seq = g_state->seq;
+	__atomic_store_n(&g_state->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	control_manager_foreach(state_write_control, NULL);
+	configuration_manager_foreach(state_write_configuration, NULL);
+	__atomic_store_n(&g_state->update_us, util_time_us(),
+			__ATOMIC_RELAXED);
+
+	__atomic_store_n(&g_state->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,50 @@
+#ifndef _STATE_H_
+#define _STATE_H_
+
+#include <stdint.h>
+
+#define STATE_MAGIC "THMSTA1"
+
+/*
+ * Layout of the state region: a header followed by one entry per control
+ * and one per configuration, in configuration file order.  Several
+ * configurations may share a sensor, so a configuration entry is named by
+ * its sensor, its kind ("threshold", "curve" or "pid") and its index among
+ * the entries for the same sensor.  Names are set once, before the magic
+ * is.  The values are updated under seq, which is
+ * odd while an update is in progress, so a client takes a consistent
+ * snapshot by reading seq, copying the values, and retrying if seq was
+ * odd or has changed by the time the copy is done.
+ */
+struct state_header {
+	char magic[8];
+	uint32_t seq;
+	uint32_t pid;
+	uint32_t ncontrols;
+	uint32_t nconfigurations;
+	uint32_t controls_offset;
+	uint32_t configurations_offset;
+	uint64_t update_us;
+};
+
+struct state_control {
+	char name[64];
+	int32_t level;
+	int32_t reserved;
+};
+
+struct state_configuration {
+	char sensor[64];
+	char kind[16];
+	uint32_t index;
+	int32_t last_value;
+	/* non-zero when a threshold is active, with its trigger and clear */
+	int32_t active;
+	int32_t trigger;
+	int32_t clear;
+};
+
+int state_start(const char *path);
+void state_publish(void);
+
+#endif
@@ -4,6 +4,8 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
+#include <dirent.h>
+#include <fnmatch.h>
 
 #include "log.h"
 #include "watch.h"
@@ -16,6 +18,20 @@ struct thermal_trip {
 	struct watch_ticket *ticket;
 };
 
+struct thermal_class_entry {
+	char kind[32];
+	int id;
+	char type[64];
+};
+
+struct thermal_class_index {
+	struct thermal_class_entry *entries;
+	int count;
+	int scanned;
+};
+
+static struct thermal_class_index g_thermal_class_index;
+
 struct thermal_zone {
 	int temp_fd;
 	int mode_fd;
@@ -205,6 +221,11 @@ int thermal_zone_read(struct thermal_zone *tz, char *buf, unsigned int blen)
 	return rc;
 }
 
+int thermal_zone_fd(struct thermal_zone *tz)
+{
+	return tz->temp_fd;
+}
+
 int thermal_zone_set_trip(struct thermal_zone *tz, int lower, int upper)
 {
 	if (thermal_trip_set(&tz->trips[0], lower))
@@ -215,3 +236,123 @@ int thermal_zone_set_trip(struct thermal_zone *tz, int lower, int upper)
 
 	return 0;
 }
+
+static int thermal_class_entry_cmp(const void *a, const void *b)
+{
+	const struct thermal_class_entry *ea = a;
+	const struct thermal_class_entry *eb = b;
+	int rc;
+
+	rc = strcmp(ea->kind, eb->kind);
+	if (rc)
+		return rc;
+	return ea->id - eb->id;
+}
+
+static int thermal_class_scan_entry(struct thermal_class_entry *entry,
+		const char *dname)
+{
+	char fname[PATH_MAX];
+	const char *digits;
+	int fd;
+	int rc;
+
+	for (digits = dname; *digits; ++digits) {
+		if (*digits >= '0' && *digits <= '9')
+			break;
+	}
+	if (*digits == 0 || digits == dname ||
+			(size_t)(digits - dname) >= sizeof(entry->kind))
+		return -1;
+
+	memcpy(entry->kind, dname, digits - dname);
+	entry->kind[digits - dname] = 0;
+	entry->id = strtol(digits, 0, 10);
+
+	snprintf(fname, sizeof(fname), THERMAL_CLASS_DIR "/%s/type", dname);
+	fd = open(fname, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	rc = read(fd, entry->type, sizeof(entry->type) - 1);
+	close(fd);
+	if (rc <= 0)
+		return -1;
+	while (rc > 0 && entry->type[rc - 1] == '\n')
+		--rc;
+	entry->type[rc] = 0;
+
+	return 0;
+}
+
+static void thermal_class_scan(struct thermal_class_index *index)
+{
+	struct thermal_class_entry *entries;
+	struct dirent *de;
+	DIR *dir;
+
+	index->scanned = 1;
+
+	dir = opendir(THERMAL_CLASS_DIR);
+	if (dir == NULL) {
+		LOGW("unable to scan " THERMAL_CLASS_DIR "\n");
+		return;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		entries = realloc(index->entries,
+				sizeof(index->entries[0]) * (index->count + 1));
+		if (entries == NULL)
+			break;
+		index->entries = entries;
+
+		if (thermal_class_scan_entry(&index->entries[index->count],
+				de->d_name) == 0)
+			index->count++;
+	}
+	closedir(dir);
+
+	qsort(index->entries, index->count, sizeof(index->entries[0]),
+			thermal_class_entry_cmp);
+}
+
+int thermal_class_match(const char *kind, const char *pattern,
+		thermal_class_match_fn fn, void *data)
+{
+	struct thermal_class_index *index = &g_thermal_class_index;
+	char dir[PATH_MAX];
+	int matches;
+	int i;
+
+	if (!index->scanned)
+		thermal_class_scan(index);
+
+	matches = 0;
+	for (i = 0; i < index->count; ++i) {
+		struct thermal_class_entry *entry = &index->entries[i];
+
+		if (strcmp(entry->kind, kind))
+			continue;
+		if (fnmatch(pattern, entry->type, 0))
+			continue;
+
+		snprintf(dir, sizeof(dir), THERMAL_CLASS_DIR "/%s%d",
+				entry->kind, entry->id);
+		(* fn)(data, dir, entry->type);
+		matches++;
+	}
+
+	return matches;
+}
+
+void thermal_class_release(void)
+{
+	struct thermal_class_index *index = &g_thermal_class_index;
+
+	free(index->entries);
+	index->entries = NULL;
+	index->count = 0;
+	index->scanned = 0;
+}
@@ -10,6 +10,16 @@ void thermal_zone_enable(struct thermal_zone *tz);
 void thermal_zone_disable(struct thermal_zone *tz);
 
 int thermal_zone_read(struct thermal_zone *tz, char *buf, unsigned int blen);
+int thermal_zone_fd(struct thermal_zone *tz);
 int thermal_zone_set_trip(struct thermal_zone *tz, int lower, int upper);
 
+#define THERMAL_CLASS_DIR "/sys/class/thermal"
+
+typedef void (* thermal_class_match_fn)(void *data,
+		const char *dir, const char *type);
+
+int thermal_class_match(const char *kind, const char *pattern,
+		thermal_class_match_fn fn, void *data);
+void thermal_class_release(void);
+
 #endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "log.h"
+#include "list.h"
+#include "watch.h"
+#include "uevent.h"
+
+struct uevent_listener {
+	char subsystem[32];
+	uevent_fn fn;
+	void *data;
+	struct list_node list_node;
+};
+
+struct uevent_manager {
+	int fd;
+	struct watch_ticket *ticket;
+	struct list listeners;
+};
+
+static struct uevent_manager g_uevent_manager = {
+	.fd = -1,
+	.listeners = LIST_INIT(listeners),
+};
+
+static int uevent_open(struct uevent_manager *um)
+{
+	struct sockaddr_nl addr;
+	int on = 1;
+	int fd;
+
+	if (um->fd != -1)
+		return 0;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			NETLINK_KOBJECT_UEVENT);
+	if (fd == -1) {
+		LOGW("unable to open uevent socket\n");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_pid = 0;
+	addr.nl_groups = 1; /* kernel events */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		LOGW("unable to bind uevent socket\n");
+		close(fd);
+		return -1;
+	}
+
+	/* needed to tell events from the kernel from forged ones */
+	if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on))) {
+		LOGW("unable to get uevent sender credentials\n");
+		close(fd);
+		return -1;
+	}
+
+	um->fd = fd;
+	return 0;
+}
+
+static void uevent_dispatch(struct uevent_manager *um, char *msg, int len)
+{
+	struct uevent_listener *l;
+	struct list_node *node;
+	const char *subsystem;
+	const char *devpath;
+	const char *action;
+	char *end = msg + len;
+	char *p;
+
+	subsystem = devpath = action = NULL;
+	for (p = msg; p < end; p += strlen(p) + 1) {
+		if (!strncmp(p, "ACTION=", 7))
+			action = p + 7;
+		else if (!strncmp(p, "DEVPATH=", 8))
+			devpath = p + 8;
+		else if (!strncmp(p, "SUBSYSTEM=", 10))
+			subsystem = p + 10;
+	}
+	if (subsystem == NULL || devpath == NULL || action == NULL)
+		return;
+
+	for_list_node(&um->listeners, node) {
+		l = list_entry(node, struct uevent_listener, list_node);
+		if (!strcmp(l->subsystem, subsystem))
+			(* l->fn)(l->data, action, devpath);
+	}
+}
+
+/*
+ * Any process may send to the uevent multicast group, so like ueventd,
+ * only messages sent by the kernel (port 0) with root credentials are
+ * accepted.  Otherwise anyone could fake cpu hotplug events.
+ */
+static int uevent_recv(struct uevent_manager *um, char *msg, unsigned int len)
+{
+	char control[CMSG_SPACE(sizeof(struct ucred))];
+	struct sockaddr_nl addr;
+	struct cmsghdr *cmsg;
+	struct ucred *cred;
+	struct msghdr hdr;
+	struct iovec iov;
+	int rc;
+
+	for (;;) {
+		iov.iov_base = msg;
+		iov.iov_len = len;
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_name = &addr;
+		hdr.msg_namelen = sizeof(addr);
+		hdr.msg_iov = &iov;
+		hdr.msg_iovlen = 1;
+		hdr.msg_control = control;
+		hdr.msg_controllen = sizeof(control);
+
+		rc = recvmsg(um->fd, &hdr, 0);
+		if (rc <= 0)
+			return rc;
+
+		cmsg = CMSG_FIRSTHDR(&hdr);
+		if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS)
+			continue;
+		cred = (struct ucred *)CMSG_DATA(cmsg);
+		if (cred->uid != 0 || addr.nl_groups == 0 || addr.nl_pid != 0) {
+			LOGW("ignoring uevent from pid %d uid %u\n",
+					cred->pid, cred->uid);
+			continue;
+		}
+		return rc;
+	}
+}
+
+static void uevent_cb(void *data, struct watch_ticket *ticket)
+{
+	struct uevent_manager *um = (struct uevent_manager *)data;
+	char msg[2048];
+	int rc;
+
+	for (;;) {
+		rc = uevent_recv(um, msg, sizeof(msg) - 1);
+		if (rc <= 0)
+			break;
+		msg[rc] = 0;
+		uevent_dispatch(um, msg, rc);
+	}
+
+	watch_ticket_clear(ticket);
+}
+
+/*
+ * The uevent socket is opened as soon as the first listener is added, so
+ * events arriving before the watch loop runs are queued rather than lost.
+ * Returns -1 if hotplug events can not be monitored.
+ */
+int uevent_listener_add(const char *subsystem, uevent_fn fn, void *data)
+{
+	struct uevent_manager *um = &g_uevent_manager;
+	struct uevent_listener *l;
+
+	if (uevent_open(um))
+		return -1;
+
+	l = calloc(1, sizeof(*l));
+	if (l == NULL)
+		return -1;
+
+	strncpy(l->subsystem, subsystem, sizeof(l->subsystem));
+	l->subsystem[sizeof(l->subsystem) - 1] = 0;
+	l->fn = fn;
+	l->data = data;
+	list_append(&um->listeners, &l->list_node);
+
+	return 0;
+}
+
+void uevent_listener_remove(uevent_fn fn, void *data)
+{
+	struct uevent_manager *um = &g_uevent_manager;
+	struct uevent_listener *l;
+	struct list_node *node;
+
+	for_list_node(&um->listeners, node) {
+		l = list_entry(node, struct uevent_listener, list_node);
+		if (l->fn == fn && l->data == data) {
+			list_remove(&um->listeners, &l->list_node);
+			free(l);
+			break;
+		}
+	}
+}
+
+void uevent_manager_enable(void)
+{
+	struct uevent_manager *um = &g_uevent_manager;
+
+	if (um->fd == -1 || um->ticket != NULL)
+		return;
+
+	um->ticket = watch_manager_add_input(um->fd);
+	if (um->ticket == NULL)
+		return;
+	watch_ticket_callback(um->ticket, uevent_cb, um);
+}
+
+void uevent_manager_disable(void)
+{
+	struct uevent_manager *um = &g_uevent_manager;
+
+	if (um->ticket != NULL) {
+		watch_ticket_delete(um->ticket);
+		um->ticket = NULL;
+	}
+}
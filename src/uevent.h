@@ -0,0 +1,13 @@
+#ifndef _UEVENT_H_
+#define _UEVENT_H_
+
+typedef void (* uevent_fn)(void *data, const char *action,
+		const char *devpath);
+
+int uevent_listener_add(const char *subsystem, uevent_fn fn, void *data);
+void uevent_listener_remove(uevent_fn fn, void *data);
+
+void uevent_manager_enable(void);
+void uevent_manager_disable(void);
+
+#endif
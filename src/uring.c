@@ -0,0 +1,273 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "uring.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#ifdef __NR_io_uring_setup
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+/*
+ * Minimal io_uring reader for sysfs style files whose whole content is
+ * read from offset 0.  The files are registered once, and a batch of reads
+ * is submitted and reaped with a single io_uring_enter().
+ */
+struct uring {
+	int fd;
+	int count;
+	unsigned int len;
+
+	void *sq_ptr;
+	size_t sq_size;
+	void *cq_ptr;
+	size_t cq_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct iovec *iovs;
+	int *results;
+	char *buffers;
+};
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int submit, unsigned int complete,
+		unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, complete, flags,
+			NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int op, void *arg,
+		unsigned int nargs)
+{
+	return syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+static int uring_map(struct uring *u, struct io_uring_params *p)
+{
+	u->sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	u->cq_size = p->cq_off.cqes +
+			p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_size > u->sq_size)
+			u->sq_size = u->cq_size;
+		u->cq_size = u->sq_size;
+	}
+
+	u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED)
+		return -1;
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ptr = u->sq_ptr;
+	} else {
+		u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, u->fd,
+				IORING_OFF_CQ_RING);
+		if (u->cq_ptr == MAP_FAILED)
+			return -1;
+	}
+
+	u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+		return -1;
+
+	u->sq_head = (unsigned int *)((char *)u->sq_ptr + p->sq_off.head);
+	u->sq_tail = (unsigned int *)((char *)u->sq_ptr + p->sq_off.tail);
+	u->sq_mask = (unsigned int *)((char *)u->sq_ptr + p->sq_off.ring_mask);
+	u->sq_array = (unsigned int *)((char *)u->sq_ptr + p->sq_off.array);
+	u->cq_head = (unsigned int *)((char *)u->cq_ptr + p->cq_off.head);
+	u->cq_tail = (unsigned int *)((char *)u->cq_ptr + p->cq_off.tail);
+	u->cq_mask = (unsigned int *)((char *)u->cq_ptr + p->cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_ptr + p->cq_off.cqes);
+
+	return 0;
+}
+
+struct uring *uring_create(const int *fds, int count, unsigned int len)
+{
+	struct io_uring_params p;
+	struct uring *u;
+	int i;
+
+	if (count <= 0)
+		return NULL;
+
+	u = calloc(1, sizeof(*u));
+	if (u == NULL)
+		return NULL;
+	u->fd = -1;
+	u->sq_ptr = u->cq_ptr = u->sqes = MAP_FAILED;
+	u->count = count;
+	u->len = len;
+
+	u->iovs = calloc(count, sizeof(u->iovs[0]));
+	u->results = calloc(count, sizeof(u->results[0]));
+	u->buffers = calloc(count, len);
+	if (u->iovs == NULL || u->results == NULL || u->buffers == NULL)
+		goto fail;
+	for (i = 0; i < count; ++i) {
+		u->iovs[i].iov_base = u->buffers + i * len;
+		u->iovs[i].iov_len = len - 1;
+	}
+
+	memset(&p, 0, sizeof(p));
+	u->fd = uring_setup(count, &p);
+	if (u->fd < 0) {
+		LOGW("io_uring unavailable\n");
+		goto fail;
+	}
+	if (p.sq_entries < (unsigned int)count)
+		goto fail;
+	if (uring_map(u, &p))
+		goto fail;
+
+	if (uring_register(u->fd, IORING_REGISTER_FILES, (void *)fds,
+			count) < 0) {
+		LOGW("unable to register files with io_uring\n");
+		goto fail;
+	}
+
+	return u;
+
+fail:
+	uring_destroy(u);
+	return NULL;
+}
+
+void uring_destroy(struct uring *u)
+{
+	if (u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqes_size);
+	if (u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+		munmap(u->cq_ptr, u->cq_size);
+	if (u->sq_ptr != MAP_FAILED)
+		munmap(u->sq_ptr, u->sq_size);
+	if (u->fd >= 0)
+		close(u->fd);
+	free(u->iovs);
+	free(u->results);
+	free(u->buffers);
+	free(u);
+}
+
+/* reads the files at indexes idx, waiting for all of them to complete */
+int uring_read(struct uring *u, const int *idx, int n)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned int tail, head;
+	int reaped;
+	int i, rc;
+
+	if (n > u->count)
+		return -1;
+
+	tail = *u->sq_tail;
+	for (i = 0; i < n; ++i) {
+		sqe = &u->sqes[tail & *u->sq_mask];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READV;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->fd = idx[i];
+		sqe->off = 0;
+		sqe->addr = (unsigned long)&u->iovs[idx[i]];
+		sqe->len = 1;
+		sqe->user_data = idx[i];
+		u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+		u->results[idx[i]] = -1;
+		tail++;
+	}
+	__atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+	rc = uring_enter(u->fd, n, n, IORING_ENTER_GETEVENTS);
+	if (rc < 0)
+		return -1;
+
+	reaped = 0;
+	head = *u->cq_head;
+	while (reaped < n) {
+		if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			if (uring_enter(u->fd, 0, n - reaped,
+					IORING_ENTER_GETEVENTS) < 0)
+				break;
+			continue;
+		}
+		cqe = &u->cqes[head & *u->cq_mask];
+		if (cqe->user_data < (unsigned long long)u->count)
+			u->results[cqe->user_data] = cqe->res;
+		head++;
+		reaped++;
+	}
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+	return -(reaped != n);
+}
+
+/* result of the last read of idx, a NUL terminated buffer */
+const char *uring_result(struct uring *u, int idx, int *rc)
+{
+	char *buf = u->buffers + idx * u->len;
+
+	*rc = u->results[idx];
+	buf[*rc > 0 ? *rc : 0] = 0;
+	return buf;
+}
+
+#else
+
+struct uring *uring_create(const int *fds __attribute__ ((__unused__)),
+		int count __attribute__ ((__unused__)),
+		unsigned int len __attribute__ ((__unused__)))
+{
+	LOGW("built without io_uring support\n");
+	return NULL;
+}
+
+void uring_destroy(struct uring *u __attribute__ ((__unused__)))
+{
+}
+
+int uring_read(struct uring *u __attribute__ ((__unused__)),
+		const int *idx __attribute__ ((__unused__)),
+		int n __attribute__ ((__unused__)))
+{
+	return -1;
+}
+
+const char *uring_result(struct uring *u __attribute__ ((__unused__)),
+		int idx __attribute__ ((__unused__)), int *rc)
+{
+	*rc = -1;
+	return "";
+}
+
+#endif
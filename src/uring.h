@@ -0,0 +1,12 @@
+#ifndef _URING_H_
+#define _URING_H_
+
+struct uring;
+
+struct uring *uring_create(const int *fds, int count, unsigned int len);
+void uring_destroy(struct uring *u);
+
+int uring_read(struct uring *u, const int *idx, int n);
+const char *uring_result(struct uring *u, int idx, int *rc);
+
+#endif
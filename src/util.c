@@ -1,4 +1,10 @@
 #include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #ifdef ANDROID
 #include <sys/reboot.h>
 #endif
@@ -14,3 +20,106 @@ void util_halt(void)
 #endif
 	_exit(1);
 }
+
+/*
+ * Parses a kernel cpu list such as "0 1 2 3" (related_cpus) or "0-3,6"
+ * (online, cpuset.cpus) into a bit mask.
+ */
+int util_parse_cpulist(const char *str, unsigned long *mask)
+{
+	unsigned long lo, hi;
+	char *end;
+
+	*mask = 0;
+	while (*str) {
+		if (*str < '0' || *str > '9') {
+			++str;
+			continue;
+		}
+		lo = hi = strtoul(str, &end, 10);
+		if (*end == '-')
+			hi = strtoul(end + 1, &end, 10);
+		if (hi >= sizeof(*mask) * 8 || lo > hi)
+			return -1;
+		for (; lo <= hi; ++lo)
+			*mask |= 1UL << lo;
+		str = end;
+	}
+	return 0;
+}
+
+int util_read_file(const char *file, char *buf, unsigned int len)
+{
+	int fd;
+	int rc;
+
+	fd = open(file, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	rc = read(fd, buf, len - 1);
+	close(fd);
+	if (rc < 0)
+		return -1;
+	buf[rc] = 0;
+	return rc;
+}
+
+unsigned long long util_time_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long long util_time_ms(void)
+{
+	return util_time_us() / 1000;
+}
+
+/*
+ * Creates a shared memory region of len bytes backed by the file at path,
+ * or by an anonymous memfd when path is NULL, and maps it.  The fd is
+ * returned through fd so other processes can be pointed at it.
+ *
+ * The path is usually in a world writable directory like /dev/shm, so
+ * whatever is there is unlinked and the file is created anew, without
+ * following a symlink planted in between.  On failure errno is set.
+ */
+void *util_shm_create(const char *path, unsigned int len, int *fd)
+{
+	void *addr;
+	int err;
+
+	if (path != NULL) {
+		if (unlink(path) && errno != ENOENT)
+			return NULL;
+		*fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW |
+				O_CLOEXEC, 0644);
+	} else {
+#ifdef __NR_memfd_create
+		/* MFD_CLOEXEC */
+		*fd = syscall(__NR_memfd_create, "thermanager", 1);
+#else
+		*fd = -1;
+		errno = ENOSYS;
+#endif
+	}
+	if (*fd == -1)
+		return NULL;
+
+	if (ftruncate(*fd, len))
+		goto fail;
+
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (addr == MAP_FAILED)
+		goto fail;
+
+	return addr;
+
+fail:
+	err = errno;
+	close(*fd);
+	*fd = -1;
+	errno = err;
+	return NULL;
+}
@@ -2,5 +2,10 @@
 #define _UTIL_H_
 
 void util_halt(void);
+int util_parse_cpulist(const char *str, unsigned long *mask);
+int util_read_file(const char *file, char *buf, unsigned int len);
+unsigned long long util_time_us(void);
+unsigned long long util_time_ms(void);
+void *util_shm_create(const char *path, unsigned int len, int *fd);
 
 #endif
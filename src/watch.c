@@ -10,6 +10,7 @@ typedef unsigned long long u64;
 enum watch_type {
 	WATCH_TYPE_NULL,
 	WATCH_TYPE_FD,
+	WATCH_TYPE_INPUT,
 	WATCH_TYPE_TIMEOUT,
 };
 
@@ -26,6 +27,8 @@ struct watch_ticket {
 
 	u64 start;
 	int updated;
+	/* slot in watch->pfds during the current wait, or -1 */
+	int pfd;
 	struct watch *watch;
 	struct list_node list_node;
 };
@@ -33,6 +36,14 @@ struct watch_ticket {
 struct watch {
 	struct list tickets;
 	int count;
+
+	/*
+	 * Grown alongside the ticket list so watch_wait never allocates.  A
+	 * callback may add tickets and move the array, so it is only ever
+	 * accessed through w->pfds.
+	 */
+	struct pollfd *pfds;
+	int npfds;
 };
 
 u64 time_ms(void)
@@ -65,6 +76,7 @@ void watch_destroy(struct watch *w)
 		free(ticket);
 	}
 
+	free(w->pfds);
 	free(w);
 }
 
@@ -96,7 +108,6 @@ void watch_synchronize(struct watch *w)
 
 void watch_wait(struct watch *w)
 {
-	struct pollfd pfds[w->count];
 	struct watch_ticket *ticket;
 	struct list_node *node;
 	u64 term_time;
@@ -109,15 +120,21 @@ void watch_wait(struct watch *w)
 	term_time = (u64)-1;
 	for_list_node(&w->tickets, node) {
 		ticket = list_entry(node, struct watch_ticket, list_node);
+		ticket->pfd = -1;
 		switch (ticket->type) {
 		case WATCH_TYPE_TIMEOUT:
 			if (ticket->start + ticket->interval < term_time)
 				term_time = ticket->start + ticket->interval;
 			break;
 		case WATCH_TYPE_FD:
-			pfds[idx].fd = ticket->filedes;
-			pfds[idx].events = POLLERR | POLLPRI;
-			idx++;
+			w->pfds[idx].fd = ticket->filedes;
+			w->pfds[idx].events = POLLERR | POLLPRI;
+			ticket->pfd = idx++;
+			break;
+		case WATCH_TYPE_INPUT:
+			w->pfds[idx].fd = ticket->filedes;
+			w->pfds[idx].events = POLLIN;
+			ticket->pfd = idx++;
 			break;
 		case WATCH_TYPE_NULL:
 			break;
@@ -126,7 +143,7 @@ void watch_wait(struct watch *w)
 	count = idx;
 
 	if (term_time == (u64)-1) { /* wait forever */
-		rc = poll(pfds, count, -1);
+		rc = poll(w->pfds, count, -1);
 	} else {
 		now = time_ms();
 		if (now >= term_time) { /* already past timeout, skip poll */
@@ -137,14 +154,13 @@ void watch_wait(struct watch *w)
 			delta = term_time - now;
 			if (delta > INT_MAX)
 				delta = INT_MAX;
-			rc = poll(pfds, count, (int)delta);
+			rc = poll(w->pfds, count, (int)delta);
 		}
 	}
 
 	if (rc < 0)
 		return;
 
-	idx = 0;
 	now = time_ms();
 	for_list_node(&w->tickets, node) {
 		int fresh = 0;
@@ -158,12 +174,19 @@ void watch_wait(struct watch *w)
 			}
 			break;
 		case WATCH_TYPE_FD:
-			if (rc == 0) /* timed-out */
+			/* timed-out, or not polled in this wait */
+			if (rc == 0 || ticket->pfd < 0)
+				break;
+			if (w->pfds[ticket->pfd].revents & (POLLERR | POLLPRI)) {
+				fresh = !ticket->updated;
+			}
+			break;
+		case WATCH_TYPE_INPUT:
+			if (rc == 0 || ticket->pfd < 0)
 				break;
-			if (pfds[idx].revents & (POLLERR | POLLPRI)) {
+			if (w->pfds[ticket->pfd].revents & POLLIN) {
 				fresh = !ticket->updated;
 			}
-			idx++;
 			break;
 		case WATCH_TYPE_NULL:
 			break;
@@ -184,12 +207,23 @@ void watch_ticket_set_null(struct watch_ticket *ticket)
 	ticket->type = WATCH_TYPE_NULL;
 }
 
+int watch_ticket_is_null(struct watch_ticket *ticket)
+{
+	return ticket->type == WATCH_TYPE_NULL;
+}
+
 void watch_ticket_set_fd(struct watch_ticket *ticket, int fd)
 {
 	ticket->type = WATCH_TYPE_FD;
 	ticket->filedes = fd;
 }
 
+void watch_ticket_set_input(struct watch_ticket *ticket, int fd)
+{
+	ticket->type = WATCH_TYPE_INPUT;
+	ticket->filedes = fd;
+}
+
 void watch_ticket_set_timeout(struct watch_ticket *ticket, unsigned int ms)
 {
 	ticket->type = WATCH_TYPE_TIMEOUT;
@@ -200,11 +234,23 @@ void watch_ticket_set_timeout(struct watch_ticket *ticket, unsigned int ms)
 struct watch_ticket *watch_add_null(struct watch *w)
 {
 	struct watch_ticket *ticket;
+	struct pollfd *pfds;
+	int npfds;
+
+	if (w->count == w->npfds) {
+		npfds = w->npfds ? w->npfds * 2 : 16;
+		pfds = realloc(w->pfds, sizeof(pfds[0]) * npfds);
+		if (pfds == NULL)
+			return NULL;
+		w->pfds = pfds;
+		w->npfds = npfds;
+	}
 
 	ticket = calloc(1, sizeof(*ticket));
 	if (ticket == NULL)
 		return NULL;
 	ticket->watch = w;
+	ticket->pfd = -1;
 
 	list_append(&w->tickets, &ticket->list_node);
 	w->count++;
@@ -227,6 +273,19 @@ struct watch_ticket *watch_add_fd(struct watch *w, int fd)
 	return ticket;
 }
 
+struct watch_ticket *watch_add_input(struct watch *w, int fd)
+{
+	struct watch_ticket *ticket;
+
+	ticket = watch_add_null(w);
+	if (ticket == NULL)
+		return NULL;
+
+	watch_ticket_set_input(ticket, fd);
+
+	return ticket;
+}
+
 struct watch_ticket *watch_add_timeout(struct watch *w, unsigned int ms)
 {
 	struct watch_ticket *ticket;
@@ -291,6 +350,13 @@ struct watch_ticket *watch_manager_add_fd(int fd)
 	return watch_add_fd(g_watch_manager_watch, fd);
 }
 
+struct watch_ticket *watch_manager_add_input(int fd)
+{
+	if (g_watch_manager_watch == NULL)
+		return NULL;
+	return watch_add_input(g_watch_manager_watch, fd);
+}
+
 struct watch_ticket *watch_manager_add_timeout(unsigned int ms)
 {
 	if (g_watch_manager_watch == NULL)
@@ -12,10 +12,13 @@ struct watch_ticket;
 
 struct watch_ticket *watch_add_null(struct watch *watch);
 struct watch_ticket *watch_add_fd(struct watch *watch, int fd);
+struct watch_ticket *watch_add_input(struct watch *watch, int fd);
 struct watch_ticket *watch_add_timeout(struct watch *watch, unsigned int ms);
 
 void watch_ticket_set_null(struct watch_ticket *ticket);
+int watch_ticket_is_null(struct watch_ticket *ticket);
 void watch_ticket_set_fd(struct watch_ticket *ticket, int fd);
+void watch_ticket_set_input(struct watch_ticket *ticket, int fd);
 void watch_ticket_set_timeout(struct watch_ticket *ticket, unsigned int ms);
 
 void watch_ticket_delete(struct watch_ticket *ticket);
@@ -27,6 +30,7 @@ void watch_ticket_callback(struct watch_ticket *ticket,
 void watch_manager_set_watch(struct watch *watch);
 struct watch_ticket *watch_manager_add_null(void);
 struct watch_ticket *watch_manager_add_fd(int fd);
+struct watch_ticket *watch_manager_add_input(int fd);
 struct watch_ticket *watch_manager_add_timeout(unsigned int ms);
 void watch_manager_wait(void);
 
@@ -0,0 +1,145 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "src/uring.h"
+
+/*
+ * Compares sampling N sensor files with one read and lseek per file, as
+ * the main loop does, against a single batched io_uring submission.
+ */
+
+typedef unsigned long long u64;
+
+static const int counts[] = { 10, 100, 1000 };
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u64 bench_read(const int *fds, int count, int iterations)
+{
+	char buf[32];
+	u64 start;
+	long sum = 0;
+	int i, j, rc;
+
+	start = now_ns();
+	for (i = 0; i < iterations; ++i) {
+		for (j = 0; j < count; ++j) {
+			rc = read(fds[j], buf, sizeof(buf) - 1);
+			lseek(fds[j], 0, SEEK_SET);
+			if (rc > 0) {
+				buf[rc] = 0;
+				sum += strtol(buf, 0, 0);
+			}
+		}
+	}
+	if (sum == 0)
+		fprintf(stderr, "warning: read nothing\n");
+	return (now_ns() - start) / iterations;
+}
+
+static u64 bench_uring(const int *fds, int count, int iterations)
+{
+	struct uring *u;
+	const char *buf;
+	int *idx;
+	u64 start;
+	long sum = 0;
+	int i, j, rc;
+
+	u = uring_create(fds, count, 32);
+	idx = calloc(count, sizeof(idx[0]));
+	if (u == NULL || idx == NULL) {
+		free(idx);
+		if (u != NULL)
+			uring_destroy(u);
+		return 0;
+	}
+	for (j = 0; j < count; ++j)
+		idx[j] = j;
+
+	start = now_ns();
+	for (i = 0; i < iterations; ++i) {
+		if (uring_read(u, idx, count))
+			break;
+		for (j = 0; j < count; ++j) {
+			buf = uring_result(u, j, &rc);
+			if (rc > 0)
+				sum += strtol(buf, 0, 0);
+		}
+	}
+	start = (now_ns() - start) / iterations;
+	if (sum == 0)
+		fprintf(stderr, "warning: read nothing\n");
+
+	free(idx);
+	uring_destroy(u);
+	return start;
+}
+
+int main(int argc, char **argv)
+{
+	const char *file = "/sys/class/thermal/thermal_zone0/temp";
+	int iterations = 1000;
+	struct rlimit rl;
+	u64 t_read, t_uring;
+	int *fds;
+	unsigned int c;
+	int i;
+
+	if (argc > 1)
+		file = argv[1];
+	if (argc > 2)
+		iterations = strtol(argv[2], 0, 0);
+	if (iterations <= 0)
+		iterations = 1;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	printf("%s, %d iterations\n", file, iterations);
+	printf("%8s %16s %16s\n", "sensors", "read+lseek us", "io_uring us");
+
+	for (c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+		fds = calloc(counts[c], sizeof(fds[0]));
+		if (fds == NULL)
+			return -1;
+		for (i = 0; i < counts[c]; ++i) {
+			fds[i] = open(file, O_RDONLY);
+			if (fds[i] == -1) {
+				fprintf(stderr, "unable to open %s %d times\n",
+						file, counts[c]);
+				while (i-- > 0)
+					close(fds[i]);
+				free(fds);
+				return -1;
+			}
+		}
+
+		t_read = bench_read(fds, counts[c], iterations);
+		t_uring = bench_uring(fds, counts[c], iterations);
+		if (t_uring)
+			printf("%8d %16.1f %16.1f\n", counts[c],
+					t_read / 1000.0, t_uring / 1000.0);
+		else
+			printf("%8d %16.1f %16s\n", counts[c],
+					t_read / 1000.0, "n/a");
+
+		for (i = 0; i < counts[c]; ++i)
+			close(fds[i]);
+		free(fds);
+	}
+
+	return 0;
+}